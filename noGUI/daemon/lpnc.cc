@@ -0,0 +1,86 @@
+/*
+lpnc.cc
+-------
+Command line client for the lpnd daemon, for use from scripts. Sends one
+netlist file as a job and prints the resulting vectors to stdout as ASCII
+columns.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <stdlib.h>
+
+#include "../src/protocol.h"
+
+using namespace std;
+
+static void
+print_usage()
+{
+    cout << "Usage: ./lpnc [options] <file.cir>" << endl;
+    cout << "  -s, --socket <path>   socket of the daemon (default " << LPND_DEFAULT_SOCKET << ")" << endl;
+    cout << "  -b, --bc <elem>=<file> boundary condition file for external element <elem>" << endl;
+    cout << "  -p, --period <t>      period of the boundary condition files" << endl;
+    cout << "  -a, --analysis <line> analysis line replacing the one in the netlist" << endl;
+    cout << "  -v, --vector <name>   vector to return (repeat for more); default all" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    string socket_path = LPND_DEFAULT_SOCKET;
+    string circuitfile;
+    JobRequest request;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if ((arg == "-s" || arg == "--socket") && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if ((arg == "-b" || arg == "--bc") && i + 1 < argc) {
+            string bc = argv[++i];
+            size_t eq = bc.find("=");
+            if (eq == string::npos) {
+                print_usage();
+                return 1;
+            }
+            request.bc_files[bc.substr(0, eq)] = bc.substr(eq + 1);
+        } else if ((arg == "-p" || arg == "--period") && i + 1 < argc) {
+            request.period = atof(argv[++i]);
+        } else if ((arg == "-a" || arg == "--analysis") && i + 1 < argc) {
+            request.analysis = argv[++i];
+        } else if ((arg == "-v" || arg == "--vector") && i + 1 < argc) {
+            request.vectors.push_back(argv[++i]);
+        } else if (arg[0] != '-' && circuitfile.empty()) {
+            circuitfile = arg;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (circuitfile.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    ifstream f(circuitfile);
+    if (!f) {
+        cerr << "Could not open " << circuitfile << endl;
+        return 1;
+    }
+    stringstream text;
+    text << f.rdbuf();
+    request.netlist = text.str();
+
+    JobResponse response;
+    if (submit_job(socket_path, request, response) != 0) {
+        cerr << "Could not submit job to lpnd at " << socket_path << endl;
+        return 1;
+    }
+    if (response.status != 0) {
+        cerr << "Job failed: " << response.message << endl;
+        return 2;
+    }
+    response.results.write_table(cout);
+    return 0;
+}
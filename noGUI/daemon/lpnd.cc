@@ -0,0 +1,200 @@
+/*
+lpnd.cc
+-------
+Long-lived simulation daemon. Accepts jobs over a Unix domain socket, using
+the protocol described in src/protocol.h, and keeps ngspice initialized and
+boundary condition files parsed between jobs.
+
+Each worker thread owns one ngspice instance and serves one connection
+(one job) at a time. A client that sends or reads nothing for a while is
+dropped, so that it cannot hold a worker from every other client.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "../src/netlist.h"
+#include "../src/spiceinstance.h"
+#include "../src/protocol.h"
+
+using namespace std;
+
+static string socket_path = LPND_DEFAULT_SOCKET;
+
+// Seconds a read or write on a client connection may wait
+static double io_timeout = 10.0;
+
+static void
+run_job(SpiceInstance &spice, const JobRequest &request, JobResponse &response);
+
+static void
+serve(int listen_fd, SpiceInstance *spice);
+
+static void
+stop(int signum);
+
+int main(int argc, char** argv)
+{
+    size_t jobs = 1;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if ((arg == "-s" || arg == "--socket") && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if ((arg == "-t" || arg == "--timeout") && i + 1 < argc) {
+            io_timeout = atof(argv[++i]);
+        } else {
+            cout << "Usage: ./lpnd [-s <socket path>] [-j <number of ngspice instances>]"
+                " [-t <client timeout in seconds>]" << endl;
+            return 1;
+        }
+    }
+    if (jobs < 1) jobs = 1;
+    if (jobs > SpiceInstance::MAX_INSTANCES) jobs = SpiceInstance::MAX_INSTANCES;
+
+    // Initialize ngspice before accepting any jobs
+    vector<SpiceInstance*> instances;
+    for (size_t i = 0; i < jobs; i++) {
+        SpiceInstance *spice = new SpiceInstance(i);
+        spice->set_verbose(false);
+        if (spice->init() != 0) {
+            cout << "Could not initialize ngspice." << endl;
+            return 1;
+        }
+        instances.push_back(spice);
+    }
+
+    struct sockaddr_un addr;
+    if (socket_path.length() >= sizeof(addr.sun_path)) {
+        cout << "Socket path is too long." << endl;
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path.c_str());
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+            listen(listen_fd, 64) != 0) {
+        cout << "Could not listen on " << socket_path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN); // clients that go away are handled by write errors
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    cout << "lpnd listening on " << socket_path << " with " << jobs
+        << " ngspice instance" << (jobs > 1 ? "s" : "") << endl;
+
+    vector<thread> workers;
+    for (SpiceInstance *spice : instances)
+        workers.push_back(thread(serve, listen_fd, spice));
+    for (thread &t : workers)
+        t.join();
+
+    return 0;
+}
+
+/* Accept connections and run one job for each, until the process is stopped */
+static void
+serve(int listen_fd, SpiceInstance *spice)
+{
+    while (true) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            cout << "accept failed: " << strerror(errno) << endl;
+            return;
+        }
+        if (io_timeout > 0) {
+            struct timeval timeout;
+            timeout.tv_sec = static_cast<time_t>(io_timeout);
+            timeout.tv_usec = static_cast<suseconds_t>((io_timeout - timeout.tv_sec) * 1e6);
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        }
+
+        JobRequest request;
+        JobResponse response;
+        if (read_request(fd, request) != 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                cout << "Dropped a client that sent no request for " << io_timeout << " s" << endl;
+                close(fd);
+                continue;
+            }
+            response.status = 1;
+            response.message = "Malformed request";
+        } else {
+            run_job(*spice, request, response);
+        }
+        write_response(fd, response);
+        close(fd);
+    }
+}
+
+/* Load, run and collect the results of one job */
+static void
+run_job(SpiceInstance &spice, const JobRequest &request, JobResponse &response)
+{
+    Netlist netlist;
+    netlist.set_interactive(false);
+    // Boundary conditions stay parsed between jobs in the BoundaryConditionCache,
+    // which is safe to use from every job at once
+    int ret = netlist.load_from_string(request.netlist, &request.bc_files, request.period);
+    if (ret != 0) {
+        response.status = 1;
+        response.message = "Error loading netlist or boundary conditions";
+        return;
+    }
+    if (!request.analysis.empty())
+        netlist.set_analysis(request.analysis);
+    // Only the requested vectors are kept by ngspice
+    netlist.add_save(request.vectors);
+
+    Results results;
+    ret = spice.load(&netlist);
+    if (ret == 0) ret = spice.run();
+    if (ret == 0) ret = spice.get_results(results);
+    spice.clear();
+    if (ret != 0) {
+        response.status = 1;
+        response.message = "Error running simulation";
+        return;
+    }
+
+    if (request.vectors.empty()) {
+        response.results = results;
+        return;
+    }
+    for (const string &name : request.vectors) {
+        const SimVector *v = results.find(name);
+        if (!v) {
+            response.status = 1;
+            response.message = "Vector not available: " + name;
+            response.results.clear();
+            return;
+        }
+        response.results.vectors.push_back(*v);
+    }
+}
+
+/* Remove the socket file on SIGINT/SIGTERM */
+static void
+stop(int signum)
+{
+    unlink(socket_path.c_str());
+    _exit(0);
+}
@@ -0,0 +1,152 @@
+/*
+autotuner.cc
+------------
+Implement Autotuner class
+*/
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+#include "autotuner.h"
+
+std::string SolverOptions::options_line() const
+{
+	std::ostringstream line;
+	line << ".options method=" << this->method << " reltol=" << this->reltol
+		<< " abstol=" << this->abstol << " trtol=" << this->trtol;
+	return line.str();
+}
+
+std::string SolverOptions::describe() const
+{
+	std::ostringstream line;
+	line << this->options_line();
+	if (this->max_step > 0) line << " tmax=" << this->max_step;
+	return line.str();
+}
+
+std::string SolverOptions::tran_line(double step, double stop, bool uic) const
+{
+	std::ostringstream line;
+	line.precision(17);
+	line << ".tran " << step << " " << stop;
+	if (this->max_step > 0) line << " 0 " << this->max_step;
+	if (uic) line << " uic";
+	return line.str();
+}
+
+int Autotuner::tune(Netlist &netlist, double period, double budget)
+{
+	double step, stop;
+	bool uic;
+	if (netlist.get_transient(step, stop, uic) != 0) {
+		std::cout << "Error: autotuning needs a .tran line" << std::endl;
+		return 1;
+	}
+	double pilot_stop = (period > 0 && period < stop) ? period : stop;
+
+	SolverOptions reference_options = { "gear", 1e-6, 1e-14, 1, step };
+	std::vector<SolverOptions> options = candidates(step);
+	options.insert(options.begin(), reference_options);
+
+	std::vector<Netlist> pilots(options.size(), netlist);
+	std::vector<Results> results(options.size());
+	std::vector<SpiceJob> jobs(options.size());
+	for (size_t i = 0; i < options.size(); i++) {
+		pilots[i].set_options(options[i].options_line());
+		pilots[i].set_analysis(options[i].tran_line(step, pilot_stop, uic));
+		jobs[i].netlist = &pilots[i];
+		jobs[i].results = &results[i];
+		jobs[i].output_file = options[i].describe();
+	}
+
+	std::cout << "Running " << jobs.size() << " pilot runs of " << pilot_stop << "s on "
+		<< this->pool->size() << " ngspice instances..." << std::endl;
+	this->pool->run(jobs);
+	if (jobs[0].status != 0) {
+		std::cout << "Error: the reference run failed" << std::endl;
+		return 1;
+	}
+
+	int best = -1;
+	for (size_t i = 1; i < jobs.size(); i++) {
+		double error = jobs[i].status == 0 ? compare(results[0], results[i]) : HUGE_VAL;
+		std::cout << options[i].describe() << ": ";
+		if (jobs[i].status != 0) {
+			std::cout << "failed" << std::endl;
+			continue;
+		}
+		std::cout << jobs[i].seconds << "s, error " << error << std::endl;
+		if (error <= budget && (best < 0 || jobs[i].seconds < jobs[best].seconds))
+			best = i;
+	}
+	if (best < 0) {
+		std::cout << "No options were within an error of " << budget << std::endl;
+		return 1;
+	}
+
+	std::cout << "Chose " << options[best].describe()
+		<< " (reference took " << jobs[0].seconds << "s)" << std::endl;
+	netlist.set_options(options[best].options_line());
+	netlist.set_analysis(options[best].tran_line(step, stop, uic));
+	return 0;
+}
+
+double Autotuner::compare(const Results &reference, const Results &run)
+{
+	const SimVector *ref_time = reference.find("time");
+	const SimVector *run_time = run.find("time");
+	if (!ref_time || !run_time || run_time->data.empty()) return HUGE_VAL;
+
+	double error = 0.0;
+	for (const SimVector &ref : reference.vectors) {
+		if (ref.name == "time" || ref.data.empty()) continue;
+		const SimVector *v = run.find(ref.name);
+		if (!v || v->data.size() != run_time->data.size()) return HUGE_VAL;
+
+		double scale = 0.0;
+		for (double x : ref.data)
+			scale = std::max(scale, std::abs(x));
+		if (scale == 0.0) scale = 1.0;
+
+		// Both time vectors increase, so one pass interpolates every point
+		const std::vector<double> &t = run_time->data;
+		size_t j = 0;
+		for (size_t i = 0; i < ref.data.size() && i < ref_time->data.size(); i++) {
+			double time = ref_time->data[i];
+			while (j + 1 < t.size() && t[j + 1] < time) j++;
+			double value;
+			if (j + 1 >= t.size() || time <= t[j]) {
+				value = v->data[j];
+			} else {
+				double f = (time - t[j]) / (t[j + 1] - t[j]);
+				value = v->data[j] + f * (v->data[j + 1] - v->data[j]);
+			}
+			error = std::max(error, std::abs(value - ref.data[i]) / scale);
+		}
+	}
+	return error;
+}
+
+std::vector<SolverOptions> Autotuner::candidates(double step)
+{
+	const char *methods[] = { "trap", "gear" };
+	double reltols[] = { 1e-3, 1e-4 };
+	double trtols[] = { 7, 1 };
+	double max_steps[] = { 0, 10 * step, 100 * step };
+
+	std::vector<SolverOptions> options;
+	for (const char *method : methods) {
+		for (double reltol : reltols) {
+			for (double trtol : trtols) {
+				for (double max_step : max_steps) {
+					SolverOptions o = { method, reltol, 1e-12, trtol, max_step };
+					options.push_back(o);
+				}
+			}
+		}
+	}
+	return options;
+}
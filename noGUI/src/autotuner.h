@@ -0,0 +1,65 @@
+/*
+Autotuner.h
+-----------
+Class to choose ngspice integration options for a circuit from short pilot runs.
+
+Each candidate set of options (integration method, reltol, trtol and the largest
+time step allowed) is tried on a transient run of one boundary condition period.
+A reference run with tight tolerances gives the accurate answer, and the fastest
+candidate whose error against it is within the budget is chosen. The pilot runs
+are spread over a SpicePool, so with several instances they run in parallel;
+their timings are then measured under load, which favours no candidate.
+*/
+#include <string>
+#include <vector>
+
+#include "netlist.h"
+#include "results.h"
+#include "spicepool.h"
+
+#ifndef __AUTOTUNER_H__
+#define __AUTOTUNER_H__
+
+struct SolverOptions
+{
+	std::string method;
+	double reltol;
+	double abstol;
+	double trtol;
+	/* Largest time step, the tmax of the .tran line, or 0 for the ngspice default */
+	double max_step;
+
+	/* The .options line for these options */
+	std::string options_line() const;
+	/* The options line, and the largest step if set */
+	std::string describe() const;
+	/* The .tran line for the given step and stop time, with max_step if set */
+	std::string tran_line(double step, double stop, bool uic) const;
+};
+
+class Autotuner
+{
+public:
+	/* Constructor: pool must be initialized */
+	Autotuner(SpicePool *pool) { this->pool = pool; }
+
+	/* Try every candidate on a run of one period of netlist, and write the fastest
+	with an error of at most budget (see compare) into netlist, as an .options
+	line and the tmax of the .tran line. Returns 0 on success, or 1 if the
+	reference run failed or no candidate was accurate enough. */
+	int tune(Netlist &netlist, double period, double budget);
+
+	/* Largest difference between a vector of run and the same vector of reference,
+	relative to the largest magnitude of the reference vector. run is linearly
+	interpolated onto the time points of reference. Returns HUGE_VAL if run lacks
+	a vector of reference. */
+	static double compare(const Results &reference, const Results &run);
+
+private:
+	SpicePool *pool;
+
+	/* The candidates for a circuit with the given .tran step */
+	static std::vector<SolverOptions> candidates(double step);
+};
+
+#endif
@@ -5,60 +5,646 @@ Implement Boundary Condition class
 */
 
 #include <iostream>
-#include <fstream>
 #include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <stdlib.h>
+#include <strings.h>
 
 #include "boundarycondition.h"
+#include "tablefile.h"
 
-BoundaryCondition::BoundaryCondition(const std::string &filename, double period) 
+constexpr double BoundaryCondition::DEFAULT_BREAKPOINT_THRESHOLD;
+
+BoundaryCondition::BoundaryCondition(const std::string &filename, double period,
+	double fourier_tolerance, Interpolation interpolation)
 {
 	this->period = period;
+	this->fourier_tolerance = fourier_tolerance;
+	this->interpolation = interpolation;
+	this->requested_interpolation = interpolation;
+	this->columns = 1;
+	this->grid_step = 0.0;
+	this->grid_scale = 0.0;
+	this->uniform_lookup = true;
+
+	Table table;
+	if (read_table(filename, table, this->error) != 0) return;
+
+	// a Fourier series instead of points, with an optional period
+	if (table.header.compare(0, 7, "fourier") == 0) {
+		if (table.columns.size() != 3) {
+			this->error = filename + ": a Fourier series has lines <k> <a_k> <b_k>";
+			return;
+		}
+		double file_period = strtod(table.header.c_str() + 7, NULL);
+		if (file_period > 0) this->period = file_period;
+		for (size_t row = 0; row < table.rows(); row++) {
+			double k = table.columns[0][row];
+			if (k < 0 || k != std::floor(k) || k > 1e6) {
+				this->error = filename + ": harmonic numbers must be whole numbers from 0";
+				return;
+			}
+			if (this->cosines.size() <= k) {
+				this->cosines.resize(k + 1, 0.0);
+				this->sines.resize(k + 1, 0.0);
+			}
+			this->cosines[k] = table.columns[1][row];
+			this->sines[k] = table.columns[2][row];
+		}
+		return;
+	}
+	if (this->read_points(filename, table) != 0) return;
+
+	size_t n = this->times.size();
+	this->find_grid_step();
+	if (this->interpolation == PERIODIC_SPLINE && !this->wraps()) {
+		std::cout << filename << ": a periodic spline needs the period to be longer than the"
+			<< " file, using a monotone cubic" << std::endl;
+		this->interpolation = MONOTONE_CUBIC;
+	}
+	if (n < 3) this->interpolation = LINEAR;
+	if (this->interpolation != LINEAR) {
+		this->first_order.assign(n * this->columns, 0.0);
+		this->second_order.assign(n * this->columns, 0.0);
+		this->third_order.assign(n * this->columns, 0.0);
+	}
+	this->slope_changes.resize(this->columns);
+	for (size_t column = 0; column < this->columns; column++) {
+		if (this->interpolation == MONOTONE_CUBIC) this->find_monotone_cubic(column);
+		if (this->interpolation == PERIODIC_SPLINE) this->find_periodic_spline(column);
+		if (this->interpolation == LINEAR) this->find_slope_changes(column);
+	}
+
+	if (fourier_tolerance > 0 && this->columns > 1) {
+		std::cout << filename << ": Fourier series are only fitted to tables of one value"
+			<< " column, using the table" << std::endl;
+	} else if (fourier_tolerance > 0) {
+		double error;
+		if (this->fit_fourier(fourier_tolerance, error)) {
+			std::cout << filename << ": " << this->get_harmonics() << " harmonics, largest error "
+				<< error << std::endl;
+		} else {
+			std::cout << filename << ": no Fourier series within " << fourier_tolerance
+				<< " of the range, using the table" << std::endl;
+		}
+	}
+}
+
+double BoundaryCondition::get_state(double time, size_t column) const
+{
+	Cursor cursor;
+	cursor.upper = this->times.size() + 1;
+	return this->get_state(time, cursor, column);
+}
+
+double BoundaryCondition::get_state(double time, Cursor &cursor, size_t column) const
+{
+	if (this->is_fourier()) return this->fourier_state(time, NULL);
+	if (this->times.empty()) return 0.0;
+	return this->state_at(this->locate(time, cursor), column);
+}
+
+void BoundaryCondition::get_states(double time, Cursor &cursor, double *states) const
+{
+	if (this->is_fourier()) {
+		states[0] = this->fourier_state(time, NULL);
+		return;
+	}
+	if (this->times.empty()) {
+		std::fill(states, states + this->columns, 0.0);
+		return;
+	}
+
+	Position position = this->locate(time, cursor);
+	size_t n = this->times.size();
+	const double *lower = this->values.data() + position.i;
+	const double *upper = this->values.data() + position.j;
+	if (this->interpolation == LINEAR) {
+		double fraction = position.fraction;
+		for (size_t column = 0; column < this->columns; column++)
+			states[column] = lower[column * n] + fraction * (upper[column * n] - lower[column * n]);
+		return;
+	}
+	double h = position.h;
+	const double *first = this->first_order.data() + position.i;
+	const double *second = this->second_order.data() + position.i;
+	const double *third = this->third_order.data() + position.i;
+	for (size_t column = 0; column < this->columns; column++) {
+		size_t k = column * n;
+		states[column] = lower[k] + h * (first[k] + h * (second[k] + h * third[k]));
+	}
+}
+
+double BoundaryCondition::get_derivative(double time, size_t column) const
+{
+	if (this->is_fourier()) {
+		double derivative;
+		this->fourier_state(time, &derivative);
+		return derivative;
+	}
+	if (this->times.size() < 2) return 0.0;
+
+	time = this->phase(time);
+	size_t upper = std::upper_bound(this->times.begin(), this->times.end(), time) - this->times.begin();
+	size_t i;
+	double t_lower, t_upper;
+	if (!this->find_segment(upper, i, t_lower, t_upper)) return 0.0;
+	size_t offset = column * this->times.size();
+	if (this->interpolation == LINEAR) {
+		size_t j = (i + 1) % this->times.size();
+		return (this->values[offset + j] - this->values[offset + i]) / (t_upper - t_lower);
+	}
+	size_t k = offset + i;
+	double h = time - t_lower;
+	return this->first_order[k] + h * (2 * this->second_order[k] + 3 * h * this->third_order[k]);
+}
+
+double BoundaryCondition::next_knot(double time) const
+{
+	if (this->times.empty() || this->interpolation != LINEAR) return HUGE_VAL;
+
+	double base = std::floor(time / this->period) * this->period;
+	std::vector<double>::const_iterator next =
+		std::upper_bound(this->times.begin(), this->times.end(), time - base + 1e-8);
+	if (next == this->times.end())
+		return base + this->period + this->times.front();
+	return base + *next;
+}
+
+void BoundaryCondition::get_breakpoints(double threshold, std::vector<double> &times,
+	size_t column) const
+{
+	if (column >= this->slope_changes.size()) return;
+	for (auto const& change : this->slope_changes[column]) {
+		if (change.second >= threshold)
+			times.push_back(change.first);
+	}
+}
+
+int BoundaryCondition::find_column(const std::string &name) const
+{
+	for (size_t column = 0; column < this->names.size(); column++) {
+		if (strcasecmp(this->names[column].c_str(), name.c_str()) == 0)
+			return column;
+	}
+	return -1;
+}
+
+/* Take the points of table: a time column and one or more value columns,
+named by the header if there is one, as there must be for more than one. The
+rows are sorted by time, keeping the last row given for a repeated time;
+files already in increasing order are taken as they are. */
+int BoundaryCondition::read_points(const std::string &filename, Table &table)
+{
+	if (table.columns.size() < 2) {
+		this->error = filename + ": expected lines <time> <value>";
+		return 1;
+	}
+	this->columns = table.columns.size() - 1;
+	if (!table.header.empty()) {
+		std::istringstream header(table.header);
+		std::string name;
+		header >> name;
+		while (header >> name)
+			this->names.push_back(name);
+		if (this->names.size() != this->columns) {
+			std::ostringstream message;
+			message << filename << ": the header names " << this->names.size()
+				<< " value columns, the table has " << this->columns;
+			this->error = message.str();
+			return 1;
+		}
+	} else if (this->columns > 1) {
+		this->error = filename + ": name the value columns in a header line"
+			" <time> <name 1> <name 2> ...";
+		return 1;
+	}
+
+	std::vector<double> &times = table.columns[0];
+	size_t rows = times.size();
+	bool increasing = true;
+	for (size_t i = 1; i < rows && increasing; i++)
+		increasing = times[i - 1] < times[i];
+	if (increasing && this->columns == 1) {
+		this->times.swap(times);
+		this->values.swap(table.columns[1]);
+		return 0;
+	}
+
+	std::vector<size_t> order(rows);
+	std::iota(order.begin(), order.end(), 0);
+	if (!increasing) {
+		std::stable_sort(order.begin(), order.end(),
+			[&times](size_t a, size_t b) { return times[a] < times[b]; });
+		size_t kept = 0;
+		for (size_t k = 0; k < rows; k++) {
+			if (kept > 0 && times[order[kept - 1]] == times[order[k]])
+				order[kept - 1] = order[k];
+			else
+				order[kept++] = order[k];
+		}
+		order.resize(kept);
+	}
+
+	this->times.reserve(order.size());
+	for (size_t row : order)
+		this->times.push_back(times[row]);
+	this->values.reserve(order.size() * this->columns);
+	for (size_t column = 1; column <= this->columns; column++) {
+		for (size_t row : order)
+			this->values.push_back(table.columns[column][row]);
+	}
+	return 0;
+}
+
+/* Record the change of slope at every point, divided by the steepest slope.
+The slope into the first point comes from the last point of the previous
+period, if the period is long enough to place it before the first point. */
+void BoundaryCondition::find_slope_changes(size_t column)
+{
+	std::vector<std::pair<double, double> > &slope_changes = this->slope_changes[column];
+	slope_changes.clear();
+	size_t n = this->times.size();
+	if (n < 2) return;
+
+	const std::vector<double> &times = this->times;
+	const double *values = this->values.data() + column * n;
+	std::vector<double> slopes;
+	for (size_t i = 0; i + 1 < n; i++)
+		slopes.push_back((values[i + 1] - values[i]) / (times[i + 1] - times[i]));
+
+	// slopes[n - 1] is the segment that wraps around to the next period
+	bool wraps = this->period > times[n - 1] - times[0];
+	if (wraps) {
+		double first = values[0];
+		double last = values[n - 1];
+		slopes.push_back((first - last) / (times[0] + this->period - times[n - 1]));
+	}
+
+	double steepest = 0.0;
+	for (double slope : slopes)
+		steepest = std::max(steepest, std::abs(slope));
+	if (steepest == 0.0) return;
 
-	// TODO: Error checking
+	for (size_t i = 0; i < n; i++) {
+		double in, out;
+		if (i == 0 || i == n - 1) {
+			if (!wraps) continue;
+			in = slopes[i == 0 ? n - 1 : i - 1];
+			out = slopes[i == 0 ? 0 : n - 1];
+		} else {
+			in = slopes[i - 1];
+			out = slopes[i];
+		}
+		double t = std::fmod(times[i], this->period);
+		if (t < 0) t += this->period;
+		slope_changes.push_back(std::make_pair(t, std::abs(out - in) / steepest));
+	}
+}
+
+/* Set grid_step if every point lies within a millionth of a step of an
+evenly spaced grid from the first point to the last */
+void BoundaryCondition::find_grid_step()
+{
+	size_t n = this->times.size();
+	if (n < 2) return;
 
-	std::ifstream f(filename);
-    char line[256];
-    while(true) {
-        // read file
-        f.getline(line, 256);
-        if(f.eof()) break;
+	double step = (this->times[n - 1] - this->times[0]) / (n - 1);
+	if (step <= 0) return;
+	for (size_t i = 0; i < n; i++) {
+		if (std::abs(this->times[i] - (this->times[0] + i * step)) > 1e-6 * step)
+			return;
+	}
+	this->grid_step = step;
+	this->grid_scale = 1.0 / step;
+}
+
+/* Replace the table by the Fourier series with the fewest harmonics whose
+largest error, at four samples per point of the table, is at most tolerance
+times the range of the values. The coefficients are found by a discrete
+Fourier transform of the samples. At most half as many harmonics as points
+are tried; if none is close enough, the table is kept and false returned.
+error is set to the largest error of the series found. */
+bool BoundaryCondition::fit_fourier(double tolerance, double &error)
+{
+	size_t n = this->times.size();
+	if (n < 2 || this->period <= this->times[n - 1] - this->times[0]) return false;
 
-        // parse time and pressure
-        std::string::size_type sz;
-        double t = stod(std::string(line), &sz);
-        double p = stod(std::string(line).substr(sz));
+	size_t m = 4 * n;
+	std::vector<double> samples(m), fit(m), cos_table(m), sin_table(m);
+	Cursor cursor;
+	double low = HUGE_VAL, high = -HUGE_VAL, mean = 0.0;
+	for (size_t j = 0; j < m; j++) {
+		samples[j] = this->get_state(j * this->period / m, cursor);
+		low = std::min(low, samples[j]);
+		high = std::max(high, samples[j]);
+		mean += samples[j];
+		cos_table[j] = std::cos(2 * M_PI * j / m);
+		sin_table[j] = std::sin(2 * M_PI * j / m);
+	}
+	mean /= m;
+	double limit = tolerance * (high - low);
 
-        // add to boundary conditions map
-        this->conditions[t] = p;
-    }
+	std::vector<double> cosines(1, mean), sines(1, 0.0);
+	error = 0.0;
+	for (size_t j = 0; j < m; j++) {
+		fit[j] = mean;
+		error = std::max(error, std::abs(samples[j] - mean));
+	}
+	for (size_t k = 1; error > limit; k++) {
+		if (k > n / 2) return false;
+		double a = 0.0, b = 0.0;
+		for (size_t j = 0; j < m; j++) {
+			a += samples[j] * cos_table[(k * j) % m];
+			b += samples[j] * sin_table[(k * j) % m];
+		}
+		a *= 2.0 / m;
+		b *= 2.0 / m;
+		cosines.push_back(a);
+		sines.push_back(b);
 
+		error = 0.0;
+		for (size_t j = 0; j < m; j++) {
+			fit[j] += a * cos_table[(k * j) % m] + b * sin_table[(k * j) % m];
+			error = std::max(error, std::abs(samples[j] - fit[j]));
+		}
+	}
+
+	this->cosines.swap(cosines);
+	this->sines.swap(sines);
+	std::vector<double>().swap(this->times);
+	std::vector<double>().swap(this->values);
+	std::vector<double>().swap(this->first_order);
+	std::vector<double>().swap(this->second_order);
+	std::vector<double>().swap(this->third_order);
+	this->slope_changes.clear();
+	this->grid_step = 0.0;
+	return true;
 }
 
-double BoundaryCondition::get_state(double time) 
+/* Sum the Fourier series at time, with cos and sin of each harmonic found
+from those of the one below by the angle addition formulas, so only one cos
+and one sin are computed. If derivative is not NULL, it is set to the
+derivative of the series. */
+double BoundaryCondition::fourier_state(double time, double *derivative) const
 {
-	std::map<double, double>::iterator high, low;
+	double omega = 2 * M_PI / this->period;
+	double theta = omega * this->phase(time);
+	double c1 = std::cos(theta), s1 = std::sin(theta);
+	double c = 1.0, s = 0.0;
+	double state = this->cosines[0], slope = 0.0;
+	for (size_t k = 1; k < this->cosines.size(); k++) {
+		double next = c * c1 - s * s1;
+		s = s * c1 + c * s1;
+		c = next;
+		state += this->cosines[k] * c + this->sines[k] * s;
+		slope += k * (this->sines[k] * c - this->cosines[k] * s);
+	}
+	if (derivative) *derivative = omega * slope;
+	return state;
+}
 
-    time = std::fmod(time, this->period);
-    high = this->conditions.lower_bound(time);
-    low = (high == this->conditions.begin() ? high : high--);
+/* Reduce time to the period, in [0, period) */
+double BoundaryCondition::phase(double time) const
+{
+	time = std::fmod(time, this->period);
+	if (time < 0) time += this->period;
+	return time;
+}
 
-    return this->interpolate(low->first, high->first, low->second, high->second, time);
+/* True if the period leaves room for a segment from the last point to the
+first point of the next period */
+bool BoundaryCondition::wraps() const
+{
+	return this->times.size() > 1 && this->period > this->times.back() - this->times.front();
 }
 
-/* Function to compute interpolated boundary condition */
-double BoundaryCondition::interpolate(
-	double t_lower, 
-	double t_upper, 
-	double c_lower, 
-	double c_upper,
-	double t
-) 
+/* Find the segment holding a time, given the index upper of the first point
+after it: set i to the index of the segment (n - 1 for the one joining the
+last point to the first point of the next period) and t_lower and t_upper to
+its ends. Returns false before the first point or after the last if the
+period leaves no room for that segment. */
+bool BoundaryCondition::find_segment(size_t upper, size_t &i, double &t_lower, double &t_upper) const
 {
-	if (std::abs(t_upper - t) <= 1e-8)
-        return c_upper;
+	size_t n = this->times.size();
+	if (upper > 0 && upper < n) {
+		i = upper - 1;
+		t_lower = this->times[i];
+		t_upper = this->times[upper];
+		return true;
+	}
+	if (!this->wraps()) return false;
+	i = n - 1;
+	t_lower = this->times[n - 1] - (upper == 0 ? this->period : 0.0);
+	t_upper = this->times[0] + (upper == 0 ? 0.0 : this->period);
+	return true;
+}
+
+/* Find where time falls, starting from cursor, and move the cursor there.
+Evenly spaced points give the segment and the fraction of the way along it
+directly. */
+BoundaryCondition::Position BoundaryCondition::locate(double time, Cursor &cursor) const
+{
+	time = this->phase(time);
+	size_t n = this->times.size();
+
+	if (this->grid_step > 0 && this->uniform_lookup) {
+		double x = (time - this->times[0]) * this->grid_scale;
+		if (x >= 0 && x < n - 1) {
+			Position position;
+			position.i = static_cast<size_t>(x);
+			position.j = position.i + 1;
+			position.fraction = x - position.i;
+			position.h = position.fraction * this->grid_step;
+			return position;
+		}
+		return this->position_below(x < 0 ? 0 : n, time);
+	}
+
+	size_t upper = cursor.upper;
 
-    if (std::abs(t_lower - t) <= 1e-8)
-        return c_lower;
+	// times[upper - 1] <= time < times[upper] once the cursor is in place
+	bool search = upper > n || (upper > 0 && this->times[upper - 1] > time);
+	for (size_t steps = 0; !search && upper < n && this->times[upper] <= time; steps++) {
+		if (steps == MAX_CURSOR_STEPS) search = true;
+		else upper++;
+	}
+	if (search)
+		upper = std::upper_bound(this->times.begin(), this->times.end(), time) - this->times.begin();
+
+	cursor.upper = upper;
+	return this->position_below(upper, time);
+}
+
+/* Position of time, given the index of the first point after it. Before the
+first point or after the last, the segment joining the last point to the
+first point of the next period is used if the period leaves room for it;
+otherwise the nearest point is held. A time within 1e-8 of either end of its
+segment is taken to be on that end. */
+BoundaryCondition::Position BoundaryCondition::position_below(size_t upper, double time) const
+{
+	Position position;
+	double t_lower, t_upper;
+	if (!this->find_segment(upper, position.i, t_lower, t_upper)) {
+		position.i = position.j = (upper == 0) ? 0 : this->times.size() - 1;
+		position.h = position.fraction = 0.0;
+		return position;
+	}
+	position.j = (position.i + 1) % this->times.size();
+	position.h = time - t_lower;
+	if (std::abs(t_upper - time) <= 1e-8)
+		position.fraction = 1.0;
+	else if (std::abs(t_lower - time) <= 1e-8)
+		position.fraction = 0.0;
+	else
+		position.fraction = position.h / (t_upper - t_lower);
+	return position;
+}
 
-	return c_lower + (t - t_lower)*(c_upper - c_lower)/(t_upper - t_lower);
-}
\ No newline at end of file
+/* State of a value column at position */
+double BoundaryCondition::state_at(const Position &position, size_t column) const
+{
+	size_t k = column * this->times.size() + position.i;
+	double c = this->values[k];
+	if (this->interpolation == LINEAR)
+		return c + position.fraction * (this->values[k + position.j - position.i] - c);
+	double h = position.h;
+	return c + h * (this->first_order[k] + h * (this->second_order[k] + h * this->third_order[k]));
+}
+
+/* Store the cubic through the ends of every segment with the given slopes
+at the points as first_order, second_order and third_order, the
+coefficients of powers of the time from the start of the segment, for the
+given value column. slopes has one entry per point. */
+void BoundaryCondition::set_hermite_coefficients(size_t column, const std::vector<double> &slopes)
+{
+	size_t n = this->times.size();
+	size_t segments = this->wraps() ? n : n - 1;
+	size_t offset = column * n;
+	const double *values = this->values.data() + offset;
+	for (size_t i = 0; i < segments; i++) {
+		size_t j = (i + 1) % n;
+		double h = (j == 0 ? this->times[0] + this->period : this->times[j]) - this->times[i];
+		double secant = (values[j] - values[i]) / h;
+		this->first_order[offset + i] = slopes[i];
+		this->second_order[offset + i] = (3 * secant - 2 * slopes[i] - slopes[j]) / h;
+		this->third_order[offset + i] = (slopes[i] + slopes[j] - 2 * secant) / (h * h);
+	}
+}
+
+/* Fritsch-Carlson monotone cubic Hermite interpolation: the slope at each
+point is the mean of the secants on either side, or 0 where they differ in
+sign, and is then limited so that the cubic on every segment stays between
+the values at its ends. The first and last points take the secant beside
+them unless the table wraps around. */
+void BoundaryCondition::find_monotone_cubic(size_t column)
+{
+	size_t n = this->times.size();
+	bool wraps = this->wraps();
+	size_t segments = wraps ? n : n - 1;
+	const double *values = this->values.data() + column * n;
+
+	std::vector<double> secants(segments);
+	for (size_t i = 0; i < segments; i++) {
+		size_t j = (i + 1) % n;
+		double h = (j == 0 ? this->times[0] + this->period : this->times[j]) - this->times[i];
+		secants[i] = (values[j] - values[i]) / h;
+	}
+
+	std::vector<double> slopes(n);
+	for (size_t i = 0; i < n; i++) {
+		if (!wraps && (i == 0 || i == n - 1)) {
+			slopes[i] = secants[i == 0 ? 0 : n - 2];
+			continue;
+		}
+		double in = secants[(i + segments - 1) % segments], out = secants[i % segments];
+		slopes[i] = (in * out <= 0) ? 0.0 : (in + out) / 2;
+	}
+
+	for (size_t i = 0; i < segments; i++) {
+		size_t j = (i + 1) % n;
+		if (secants[i] == 0) {
+			slopes[i] = slopes[j] = 0.0;
+			continue;
+		}
+		double alpha = slopes[i] / secants[i], beta = slopes[j] / secants[i];
+		double length = alpha * alpha + beta * beta;
+		if (length > 9) {
+			double tau = 3 / std::sqrt(length);
+			slopes[i] = tau * alpha * secants[i];
+			slopes[j] = tau * beta * secants[i];
+		}
+	}
+	this->set_hermite_coefficients(column, slopes);
+}
+
+/* Periodic cubic spline: the second derivatives M at the points solve the
+cyclic tridiagonal system
+	h[i-1] M[i-1] + 2 (h[i-1] + h[i]) M[i] + h[i] M[i+1] = 6 (secant[i] - secant[i-1])
+which is solved as a tridiagonal one corrected by the Sherman-Morrison
+formula. The spline and its first two derivatives are continuous, also from
+one period to the next. */
+void BoundaryCondition::find_periodic_spline(size_t column)
+{
+	size_t n = this->times.size();
+	size_t offset = column * n;
+	const double *values = this->values.data() + offset;
+	std::vector<double> widths(n), secants(n);
+	for (size_t i = 0; i < n; i++) {
+		size_t j = (i + 1) % n;
+		widths[i] = (j == 0 ? this->times[0] + this->period : this->times[j]) - this->times[i];
+		secants[i] = (values[j] - values[i]) / widths[i];
+	}
+
+	std::vector<double> lower(n), diagonal(n), upper(n), rhs(n);
+	for (size_t i = 0; i < n; i++) {
+		size_t before = (i + n - 1) % n;
+		lower[i] = widths[before];
+		diagonal[i] = 2 * (widths[before] + widths[i]);
+		upper[i] = widths[i];
+		rhs[i] = 6 * (secants[i] - secants[before]);
+	}
+
+	// corner entries: row 0 column n - 1 and row n - 1 column 0 are both widths[n - 1]
+	double corner = widths[n - 1];
+	double gamma = -diagonal[0];
+	diagonal[0] -= gamma;
+	diagonal[n - 1] -= corner * corner / gamma;
+	std::vector<double> moments = rhs, z(n, 0.0);
+	z[0] = gamma;
+	z[n - 1] = corner;
+	solve_tridiagonal(lower, diagonal, upper, moments);
+	solve_tridiagonal(lower, diagonal, upper, z);
+	double factor = (moments[0] + corner * moments[n - 1] / gamma)
+		/ (1 + z[0] + corner * z[n - 1] / gamma);
+	for (size_t i = 0; i < n; i++)
+		moments[i] -= factor * z[i];
+
+	for (size_t i = 0; i < n; i++) {
+		size_t j = (i + 1) % n;
+		this->first_order[offset + i] = secants[i] - widths[i] * (2 * moments[i] + moments[j]) / 6;
+		this->second_order[offset + i] = moments[i] / 2;
+		this->third_order[offset + i] = (moments[j] - moments[i]) / (6 * widths[i]);
+	}
+}
+
+/* Solve the tridiagonal system with the given diagonals in place of x, which
+holds the right hand side (the Thomas algorithm). lower[0] and upper[n - 1]
+are not used. */
+void BoundaryCondition::solve_tridiagonal(const std::vector<double> &lower,
+	const std::vector<double> &diagonal, const std::vector<double> &upper, std::vector<double> &x)
+{
+	size_t n = x.size();
+	std::vector<double> scaled(n);
+	double pivot = diagonal[0];
+	x[0] /= pivot;
+	for (size_t i = 1; i < n; i++) {
+		scaled[i] = upper[i - 1] / pivot;
+		pivot = diagonal[i] - lower[i] * scaled[i];
+		x[i] = (x[i] - lower[i] * x[i - 1]) / pivot;
+	}
+	for (size_t i = n - 1; i > 0; i--)
+		x[i - 1] -= scaled[i] * x[i];
+}
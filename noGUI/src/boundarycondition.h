@@ -5,11 +5,26 @@ Class to represent the boundary conditions for an element.
 
 A file given to the BoundaryCondition constructor should have each line formatted:
 <time> <value>\n
-Where time and value are doubles.
-The behavior of a BoundaryCondition with an invalid file is undefined.
+Where time and value are doubles. A table may instead have several value
+columns sharing the time column, named in a header line:
+<name> <name 1> <name 2> ...\n
+<time> <value 1> <value 2> ...\n
+so that one file holds the inputs of many elements, each reading the column
+named after it. The values are kept column by column, and get_states() finds
+the segment holding a time once for all of them.
+Alternatively, a file whose first line is "fourier [<period>]" holds a truncated
+Fourier series, one harmonic per line:
+<k> <a_k> <b_k>\n
+giving the state a_0 + sum of a_k cos(2 pi k t / period) + b_k sin(2 pi k t / period).
+Files are read with read_table (see tablefile.h), so they may also be binary
+tables. A file that cannot be read leaves the BoundaryCondition invalid, with
+a message giving the line at fault.
 */
 #include <string>
-#include <map>
+#include <vector>
+#include <utility>
+
+#include "tablefile.h"
 
 #ifndef __BOUNDARYCONDITION_H__
 #define __BOUNDARYCONDITION_H__
@@ -17,20 +32,158 @@ The behavior of a BoundaryCondition with an invalid file is undefined.
 class BoundaryCondition
 {
 public:
-	/* Constructor: read given file into conditions map, and save period */
-	BoundaryCondition(const std::string &filename, double period);
+	/* How the state is interpolated between the points of a table. LINEAR has
+	a corner at every point, so ngspice steps are made to end on the points.
+	MONOTONE_CUBIC (Fritsch-Carlson) has a continuous slope and never over-
+	shoots the values of the file; PERIODIC_SPLINE also has a continuous
+	second derivative, but may overshoot, and needs the period to leave room
+	after the last point. Cubic segments are precomputed when the file is
+	read, and are not landed on by ngspice. */
+	enum Interpolation { LINEAR, MONOTONE_CUBIC, PERIODIC_SPLINE };
+
+	/* Constructor: read given file into conditions map, and save period. If
+	fourier_tolerance is above 0, the table is replaced by the Fourier series
+	with the fewest harmonics that stays within fourier_tolerance times the
+	range of the values of the file (see fit_fourier). */
+	BoundaryCondition(const std::string &filename, double period, double fourier_tolerance = 0.0,
+		Interpolation interpolation = LINEAR);
 	~BoundaryCondition() {}
 
-	/* Return the state at the given time, linearly interpolating between the 
-	two closest defined points. */
-	double get_state(double time);
+	/* False if the file could not be read, with the reason in get_error() */
+	bool is_valid() const { return this->error.empty(); }
+	const std::string& get_error() const { return this->error; }
+
+	/* Position of a consumer in the table: the index of the first point after
+	the time it last asked for. Each thread reading the state keeps its own. */
+	struct Cursor {
+		size_t upper = 0;
+	};
+
+	/* Return the state of the given value column at the given time, linearly
+	interpolating between the two closest defined points. Past the last point
+	the state is interpolated towards the first point of the next period. */
+	double get_state(double time, size_t column = 0) const;
+
+	/* As above, but start looking from cursor, which is moved to time. For
+	times that only increase, as in a transient run, this is amortized O(1);
+	a jump backwards (a rejected step) or far ahead falls back to a binary
+	search. */
+	double get_state(double time, Cursor &cursor, size_t column = 0) const;
+
+	/* Set states[c] to the state of every value column c at the given time,
+	finding the segment holding time and the weights of its ends only once */
+	void get_states(double time, Cursor &cursor, double *states) const;
+
+	/* Return the rate of change of the state at the given time: the derivative
+	of the Fourier series, or the slope of the table segment holding time */
+	double get_derivative(double time, size_t column = 0) const;
+
+	/* Return the first time after the given time at which a point is defined
+	in the file, taking the period into account. Points within 1e-8 of time
+	are skipped, as time is considered to be on them already. A Fourier series
+	or a cubic interpolation does not need its points landed on, and returns
+	HUGE_VAL. */
+	double next_knot(double time) const;
+
+	/* Append to times the points in one period, in [0, period), at which the
+	slope of the interpolated state changes by at least threshold. The change
+	is measured relative to the steepest slope in the file, so it is at most 2
+	(a slope reversing sign), and a threshold above 2 finds no points. */
+	void get_breakpoints(double threshold, std::vector<double> &times, size_t column = 0) const;
+
+	double get_period() const { return this->period; }
+
+	/* Number of value columns, 1 for a Fourier series */
+	size_t get_columns() const { return this->columns; }
+	/* Index of the value column named name in the header, ignoring case, or -1
+	if the columns are not named or none is */
+	int find_column(const std::string &name) const;
+
+	/* True if the state is given by a Fourier series instead of a table */
+	bool is_fourier() const { return !this->cosines.empty(); }
+	/* Number of harmonics of the Fourier series */
+	size_t get_harmonics() const { return this->cosines.empty() ? 0 : this->cosines.size() - 1; }
+	/* Tolerance given to the constructor, whether or not a series was fitted */
+	double get_fourier_tolerance() const { return this->fourier_tolerance; }
+	/* Interpolation used, which is LINEAR for files of fewer than 3 points and
+	MONOTONE_CUBIC if a periodic spline does not fit, and the one asked for */
+	Interpolation get_interpolation() const { return this->interpolation; }
+	Interpolation get_requested_interpolation() const { return this->requested_interpolation; }
+
+	/* True if the points of the file are evenly spaced in time. Their state
+	is then found by index arithmetic instead of a search. */
+	bool is_uniform() const { return this->grid_step > 0; }
+
+	/* Turn the index arithmetic for evenly spaced files off or back on, to
+	compare it with the search */
+	void set_uniform_lookup(bool enabled) { this->uniform_lookup = enabled; }
+
+	/* The points of the file, sorted by time. The values hold one column
+	after another, each as long as the times. */
+	const std::vector<double>& get_times() const { return this->times; }
+	const std::vector<double>& get_values() const { return this->values; }
+
+	static constexpr double DEFAULT_BREAKPOINT_THRESHOLD = 0.5;
 
 
 private:
-	std::map<double, double> conditions;
+	// Points of the file sorted by time; a repeated time keeps its last value.
+	// Value column c is values[c * n] to values[c * n + n - 1].
+	std::vector<double> times;
+	std::vector<double> values;
+	size_t columns;
+	std::vector<std::string> names;
 	double period;
+	// Spacing of the points and its inverse if they are evenly spaced, else 0
+	double grid_step;
+	double grid_scale;
+	bool uniform_lookup;
+	// Fourier coefficients a_k and b_k, k = 0..K (b_0 is unused), or empty
+	std::vector<double> cosines;
+	std::vector<double> sines;
+	double fourier_tolerance;
+	std::string error;
+	// Cubic segment i is values[i] + h (first_order[i] + h (second_order[i] +
+	// h third_order[i])), h the time from times[i]; segment n - 1 wraps around.
+	// The coefficients are kept column by column, as the values are.
+	Interpolation interpolation;
+	Interpolation requested_interpolation;
+	std::vector<double> first_order;
+	std::vector<double> second_order;
+	std::vector<double> third_order;
+	// Relative change of slope at each point of each column, found when the
+	// file is read
+	std::vector<std::vector<std::pair<double, double> > > slope_changes;
+
+	/* Where a time falls in the table: on the segment from point i to point j,
+	h after point i and fraction of the way to j. A time held at a point has
+	j = i and h = fraction = 0. */
+	struct Position {
+		size_t i;
+		size_t j;
+		double h;
+		double fraction;
+	};
+
+	// Points the cursor steps over before giving up for a binary search
+	static const size_t MAX_CURSOR_STEPS = 8;
 
-	double interpolate(double t_lower, double t_upper, double c_lower, double c_upper, double t);
+	int read_points(const std::string &filename, Table &table);
+	void find_grid_step();
+	bool fit_fourier(double tolerance, double &error);
+	double fourier_state(double time, double *derivative) const;
+	double phase(double time) const;
+	bool wraps() const;
+	bool find_segment(size_t upper, size_t &i, double &t_lower, double &t_upper) const;
+	Position locate(double time, Cursor &cursor) const;
+	Position position_below(size_t upper, double time) const;
+	double state_at(const Position &position, size_t column) const;
+	void set_hermite_coefficients(size_t column, const std::vector<double> &slopes);
+	void find_monotone_cubic(size_t column);
+	void find_periodic_spline(size_t column);
+	static void solve_tridiagonal(const std::vector<double> &lower, const std::vector<double> &diagonal,
+		const std::vector<double> &upper, std::vector<double> &x);
+	void find_slope_changes(size_t column);
 
 };
 
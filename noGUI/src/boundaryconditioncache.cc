@@ -0,0 +1,152 @@
+/*
+boundaryconditioncache.cc
+-------------------------
+Implement the process-wide boundary condition cache
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "boundaryconditioncache.h"
+
+BoundaryConditionCache& BoundaryConditionCache::instance()
+{
+	static BoundaryConditionCache cache;
+	return cache;
+}
+
+BoundaryConditionCache::BoundaryConditionCache()
+{
+	this->capacity = 0;
+	this->hits = 0;
+	this->misses = 0;
+	this->clock = 0;
+}
+
+std::shared_ptr<const BoundaryCondition> BoundaryConditionCache::get(const std::string &filename,
+	double period, double fourier_tolerance, BoundaryCondition::Interpolation interpolation)
+{
+	struct stat info;
+	bool exists = stat(filename.c_str(), &info) == 0;
+	int64_t modified = exists ? info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec : 0;
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	FileState state;
+	std::map<std::string, FileState>::iterator file = this->files.find(filename);
+	if (exists && file != this->files.end() && file->second.modified == modified
+		&& file->second.size == info.st_size) {
+		state = file->second;
+	} else {
+		// hash without holding the lock, as the file may be large
+		lock.unlock();
+		int ret = exists ? hash_file(filename, state) : 1;
+		lock.lock();
+		if (ret != 0) {
+			this->misses++;
+			// let the constructor report why the file cannot be read
+			return std::make_shared<const BoundaryCondition>(filename, period, fourier_tolerance,
+				interpolation);
+		}
+		state.modified = modified;
+		this->files[filename] = state;
+	}
+
+	ContentKey key(state.hash, state.size, period, fourier_tolerance, interpolation);
+	std::map<ContentKey, Entry>::iterator entry = this->entries.find(key);
+	if (entry != this->entries.end()) {
+		this->hits++;
+		entry->second.last_used = ++this->clock;
+		return entry->second.condition;
+	}
+
+	this->misses++;
+	lock.unlock();
+	std::shared_ptr<const BoundaryCondition> condition = std::make_shared<const BoundaryCondition>(
+		filename, period, fourier_tolerance, interpolation);
+	if (!condition->is_valid()) return condition;
+	lock.lock();
+	Entry &added = this->entries[key];
+	added.condition = condition;
+	added.last_used = ++this->clock;
+	this->evict();
+	return condition;
+}
+
+void BoundaryConditionCache::set_capacity(size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->capacity = capacity;
+	this->evict();
+}
+
+size_t BoundaryConditionCache::get_hits() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->hits;
+}
+
+size_t BoundaryConditionCache::get_misses() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->misses;
+}
+
+size_t BoundaryConditionCache::size() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->entries.size();
+}
+
+void BoundaryConditionCache::clear()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->files.clear();
+	this->entries.clear();
+	this->hits = 0;
+	this->misses = 0;
+}
+
+/* Forget the least recently used conditions until at most capacity are left.
+Called with the mutex held. */
+void BoundaryConditionCache::evict()
+{
+	while (this->capacity > 0 && this->entries.size() > this->capacity) {
+		std::map<ContentKey, Entry>::iterator oldest = this->entries.begin();
+		for (auto it = this->entries.begin(); it != this->entries.end(); ++it) {
+			if (it->second.last_used < oldest->second.last_used) oldest = it;
+		}
+		this->entries.erase(oldest);
+	}
+}
+
+/* Set the size and 64-bit FNV-1a hash of the contents of a file. Returns 0 on
+success, or 1 if the file cannot be read. */
+int BoundaryConditionCache::hash_file(const std::string &filename, FileState &state)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return 1;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return 1;
+	}
+	size_t size = info.st_size;
+	void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return 1;
+	madvise(data, size, MADV_SEQUENTIAL);
+
+	const unsigned char *bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	munmap(data, size);
+
+	state.size = size;
+	state.hash = hash;
+	return 0;
+}
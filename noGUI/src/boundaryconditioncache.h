@@ -0,0 +1,88 @@
+/*
+BoundaryConditionCache.h
+------------------------
+Process-wide cache of the boundary conditions read from files, handed out as
+shared, immutable BoundaryConditions.
+
+A file is known by its path, modification time and size, and by a hash of
+its contents. A path whose modification time and size have not changed since
+it was read is a hit without touching the file. Otherwise the file is hashed,
+and a file with the same contents as one read before (a copy, or a file
+touched without being changed) is still a hit, so each waveform is parsed
+only once however many runs, netlists or names use it. A condition is cached
+per period, Fourier tolerance and interpolation, as these change what is read.
+
+The cache may hold at most a given number of conditions, forgetting the least
+recently used; conditions handed out stay valid for as long as they are held.
+All functions may be called from any thread.
+*/
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <stdint.h>
+
+#include "boundarycondition.h"
+
+#ifndef __BOUNDARYCONDITIONCACHE_H__
+#define __BOUNDARYCONDITIONCACHE_H__
+
+class BoundaryConditionCache
+{
+public:
+	/* The cache of the process */
+	static BoundaryConditionCache& instance();
+
+	/* Return the boundary condition read from filename with the given
+	settings, reading the file only if it has not been read with them before.
+	A file that cannot be read gives an invalid condition (see
+	BoundaryCondition::is_valid), which is not cached. */
+	std::shared_ptr<const BoundaryCondition> get(const std::string &filename, double period,
+		double fourier_tolerance = 0.0,
+		BoundaryCondition::Interpolation interpolation = BoundaryCondition::LINEAR);
+
+	/* Keep at most capacity conditions, forgetting the least recently used
+	first; 0 (the default) keeps every one */
+	void set_capacity(size_t capacity);
+
+	/* Conditions found in the cache, and read from file */
+	size_t get_hits() const;
+	size_t get_misses() const;
+	/* Number of conditions held */
+	size_t size() const;
+
+	/* Forget every condition and reset the counters */
+	void clear();
+
+private:
+	BoundaryConditionCache();
+	BoundaryConditionCache(const BoundaryConditionCache&) = delete;
+	BoundaryConditionCache &operator=(const BoundaryConditionCache&) = delete;
+
+	// What a path held when it was last hashed
+	struct FileState {
+		int64_t modified;
+		int64_t size;
+		uint64_t hash;
+	};
+	// Contents (hash and size) and settings a condition was read with
+	typedef std::tuple<uint64_t, int64_t, double, double, int> ContentKey;
+	struct Entry {
+		std::shared_ptr<const BoundaryCondition> condition;
+		uint64_t last_used;
+	};
+
+	mutable std::mutex mutex;
+	std::map<std::string, FileState> files;
+	std::map<ContentKey, Entry> entries;
+	size_t capacity;
+	size_t hits;
+	size_t misses;
+	uint64_t clock;
+
+	void evict();
+	static int hash_file(const std::string &filename, FileState &state);
+};
+
+#endif
@@ -0,0 +1,98 @@
+/*
+checkpoint.cc
+-------------
+Implement Checkpoint class
+*/
+
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+
+#include "checkpoint.h"
+
+static const char MAGIC[8] = { 'L', 'P', 'N', 'C', 'K', 'P', 'T', '1' };
+
+template <typename T>
+static void
+put(std::ostream &out, const T &value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool
+get(std::istream &in, T &value)
+{
+    return (bool) in.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+static void
+put_values(std::ostream &out, const std::map<std::string, double> &values);
+
+static bool
+get_values(std::istream &in, std::map<std::string, double> &values);
+
+int Checkpoint::write(const std::string &filename) const
+{
+	std::string temporary = filename + ".tmp";
+	{
+		std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+		out.write(MAGIC, sizeof(MAGIC));
+		put(out, this->next_window);
+		put(out, this->window);
+		put(out, this->step);
+		put(out, this->time);
+		put(out, this->phase);
+		put(out, this->output_offset);
+		put_values(out, this->node_voltages);
+		put_values(out, this->inductor_currents);
+		out.flush();
+		if (!out) return 1;
+	}
+	return rename(temporary.c_str(), filename.c_str()) == 0 ? 0 : 1;
+}
+
+int Checkpoint::read(const std::string &filename)
+{
+	std::ifstream in(filename.c_str(), std::ios::binary);
+	char magic[sizeof(MAGIC)];
+	if (!in.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+		return 1;
+
+	this->node_voltages.clear();
+	this->inductor_currents.clear();
+	if (!get(in, this->next_window) || !get(in, this->window) || !get(in, this->step) ||
+		!get(in, this->time) || !get(in, this->phase) || !get(in, this->output_offset) ||
+		!get_values(in, this->node_voltages) || !get_values(in, this->inductor_currents))
+		return 1;
+	return 0;
+}
+
+static void
+put_values(std::ostream &out, const std::map<std::string, double> &values)
+{
+    uint32_t count = values.size();
+    put(out, count);
+    for (auto const& value : values) {
+        uint32_t name_len = value.first.length();
+        put(out, name_len);
+        out.write(value.first.data(), name_len);
+        put(out, value.second);
+    }
+}
+
+static bool
+get_values(std::istream &in, std::map<std::string, double> &values)
+{
+    uint32_t count;
+    if (!get(in, count)) return false;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t name_len;
+        if (!get(in, name_len) || name_len > 4096) return false;
+        std::string name(name_len, '\0');
+        double value;
+        if (!in.read(&name[0], name_len) || !get(in, value)) return false;
+        values[name] = value;
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+/*
+Checkpoint.h
+------------
+Class to save and restore the state of a windowed transient run, so that a
+run that was killed can be resumed where it stopped.
+
+A checkpoint is taken at the end of a window, and holds everything the next
+window starts from: its index and start time, the phase of the boundary
+conditions at that time, the final value of every node voltage and inductor
+current (capacitor charges follow from the node voltages), and how many bytes
+of output had been written. The file is binary, in the byte order of the
+machine:
+
+<8 bytes "LPNCKPT1"> <uint64 next window> <float64 window> <float64 step>
+<float64 time> <float64 phase> <uint64 output offset>
+<uint32 number of node voltages> <uint32 name length> <name> <float64 value>...
+<uint32 number of inductor currents> <uint32 name length> <name> <float64 value>...
+
+Values are stored exactly, so a resumed run gives the same results as one
+that was never stopped.
+*/
+#include <string>
+#include <map>
+#include <stdint.h>
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+struct Checkpoint
+{
+	/* Index of the window to run next */
+	uint64_t next_window;
+	/* Length of the windows and time step of the run */
+	double window;
+	double step;
+	/* Start time of the next window, and the boundary condition phase at it */
+	double time;
+	double phase;
+	/* Bytes of output written before the next window */
+	uint64_t output_offset;
+	std::map<std::string, double> node_voltages;
+	std::map<std::string, double> inductor_currents;
+
+	Checkpoint() : next_window(0), window(0.0), step(0.0), time(0.0), phase(0.0),
+		output_offset(0) {}
+
+	/* Write the checkpoint to a temporary file and rename it over filename, so
+	that a run killed while writing leaves the previous checkpoint intact.
+	Returns 0 on success. */
+	int write(const std::string &filename) const;
+
+	/* Read a checkpoint written by write(). Returns 0 on success. */
+	int read(const std::string &filename);
+};
+
+#endif
@@ -0,0 +1,158 @@
+/*
+forkserver.cc
+-------------
+Implement ForkServer class
+*/
+
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/wait.h>
+
+#include "forkserver.h"
+
+/* In a child, close every descriptor above stderr except keep, such as the
+pipes of other jobs that were open in the parent when it forked */
+static void
+close_other_descriptors(int keep)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir) {
+        std::vector<int> fds;
+        int own = dirfd(dir);
+        while (struct dirent *entry = readdir(dir)) {
+            int fd = atoi(entry->d_name);
+            if (fd > 2 && fd != keep && fd != own) fds.push_back(fd);
+        }
+        closedir(dir);
+        for (int fd : fds)
+            close(fd);
+        return;
+    }
+    long max = sysconf(_SC_OPEN_MAX);
+    if (max < 0 || max > 65536) max = 65536;
+    for (int fd = 3; fd < max; fd++) {
+        if (fd != keep) close(fd);
+    }
+}
+
+int ForkServer::run(std::vector<SpiceJob> &jobs, size_t concurrency)
+{
+	std::mutex queue_mutex;
+	size_t next_job = 0;
+	int failed = 0;
+
+	// Each thread waits on one child at a time, so at most concurrency
+	// children run at once.
+	auto worker = [&]() {
+		while (true) {
+			SpiceJob *job;
+			{
+				std::lock_guard<std::mutex> lock(queue_mutex);
+				if (next_job == jobs.size()) return;
+				job = &jobs[next_job++];
+			}
+
+			Results results;
+			auto start = std::chrono::steady_clock::now();
+			job->status = this->run_job(*job, results);
+			job->seconds = std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - start).count();
+			bool aborted = (job->status == SpiceInstance::ABORTED);
+			if (aborted) job->status = 0;
+			if (job->status == 0 && job->results) {
+				*job->results = results;
+			} else if (job->status == 0) {
+				std::ofstream out(job->output_file);
+				results.write_table(out);
+				if (!out) job->status = 1;
+			}
+			if (aborted && job->status == 0) job->status = SpiceInstance::ABORTED;
+
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			if (job->status == SpiceInstance::ABORTED) {
+				failed++;
+				std::cout << "Job " << job->output_file << " stopped early." << std::endl;
+			} else if (job->status != 0) {
+				failed++;
+				std::cout << "Job " << job->output_file << " failed." << std::endl;
+			} else if (!job->results) {
+				std::cout << "Job " << job->output_file << " finished." << std::endl;
+			}
+		}
+	};
+
+	if (concurrency < 1) concurrency = 1;
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < concurrency && i < jobs.size(); i++)
+		workers.push_back(std::thread(worker));
+	for (std::thread &t : workers)
+		t.join();
+
+	return failed;
+}
+
+int ForkServer::run_job(SpiceJob &job, Results &results)
+{
+	// The pipe is made and forked under the lock, and its write end closed in
+	// the parent before any other child is forked. Otherwise a sibling could
+	// hold the write end open, and the parent would not see the end of the
+	// pipe if this child died before its end frame.
+	int fds[2];
+	std::unique_lock<std::mutex> lock(this->fork_mutex);
+	if (pipe(fds) != 0) return 1;
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return 1;
+	}
+
+	if (pid == 0) {
+		// Child: only this thread exists here. Leave with _exit so nothing
+		// set up by the parent (or by ngspice) is torn down twice.
+		close_other_descriptors(fds[1]);
+		signal(SIGPIPE, SIG_IGN);
+		Results child_results;
+		int status = this->instance->load(job.netlist);
+		if (status == 0) status = this->instance->run();
+		// A run stopped early still sends its results so far
+		bool aborted = (status == SpiceInstance::ABORTED);
+		if (aborted) status = 0;
+		if (status == 0) status = this->instance->get_results(child_results);
+		if (status == 0) status = child_results.write_frames(fds[1]);
+		close(fds[1]);
+		if (status == 0 && aborted) _exit(SpiceInstance::ABORTED);
+		_exit(status == 0 ? 0 : 1);
+	}
+
+	// Parent: read until the end frame, then reap the child
+	close(fds[1]);
+	lock.unlock();
+	int ret = results.read_frames(fds[0]);
+	close(fds[0]);
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) return 1;
+	}
+	if (WIFSIGNALED(status)) {
+		std::cout << "Job " << job.output_file << " was killed by signal "
+			<< WTERMSIG(status) << "." << std::endl;
+		return 1;
+	}
+	if (ret != 0 || !WIFEXITED(status))
+		return 1;
+	if (WEXITSTATUS(status) == SpiceInstance::ABORTED)
+		return SpiceInstance::ABORTED;
+	return WEXITSTATUS(status) == 0 ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+/*
+ForkServer.h
+------------
+Class to run each circuit in a child process forked from one initialized ngspice.
+
+Loading the library, ngSpice_Init, and reading the ngspice init scripts and
+code models are done once, in the parent. Each job then runs in a copy-on-write
+child of the parent, so starting a job costs little more than the fork, and a
+job that crashes ngspice does not affect the others. The child loads its netlist,
+runs it, and streams the resulting vectors back to the parent over a pipe as
+Results frames.
+
+Netlists (and their BoundaryConditions) should be loaded before run() is called,
+so that the children share them with the parent instead of reading them again.
+*/
+#include <vector>
+#include <mutex>
+
+#include "spiceinstance.h"
+#include "spicepool.h"
+
+#ifndef __FORKSERVER_H__
+#define __FORKSERVER_H__
+
+class ForkServer
+{
+public:
+	/* Constructor: instance must be initialized, and have no circuit loaded */
+	ForkServer(SpiceInstance *instance) { this->instance = instance; }
+
+	/* Run all jobs, with at most concurrency children at a time, and write the
+	results of each job as an ASCII table to its output file, or copy them to its
+	results if given. Blocks until every job is finished. Returns the number of
+	failed jobs, counting jobs that were stopped early. */
+	int run(std::vector<SpiceJob> &jobs, size_t concurrency = 1);
+
+	/* Run a single job in a child, and read its results. Returns 0 on success, or
+	SpiceInstance::ABORTED if the child stopped the run early. */
+	int run_job(SpiceJob &job, Results &results);
+
+private:
+	SpiceInstance *instance;
+	// Held from creating a job's pipe until the parent has closed its write
+	// end, so that no other job's child is forked holding a copy of it
+	std::mutex fork_mutex;
+};
+
+#endif
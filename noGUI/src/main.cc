@@ -14,68 +14,231 @@ TODO: error checking
 #include <fstream>
 #include <map>
 #include <set>
+#include <vector>
 #include <cmath>
+#include <sstream>
+#include <chrono>
 
 #include <stdlib.h>
 #include <stdio.h>
-#define bool int
-#define true 1
-#define false 0
-#include <signal.h>
-#include <unistd.h>
 #include <ctype.h>
-#include <pthread.h>
 #include <string.h>
+#include <unistd.h>
+#include <signal.h>
 
-#include "sharedspice.h"
 #include "netlist.h"
+#include "sourcehandles.h"
+#include "boundaryconditioncache.h"
+#include "spiceinstance.h"
+#include "spicepool.h"
+#include "forkserver.h"
+#include "windowedrun.h"
+#include "autotuner.h"
+#include "progressmonitor.h"
 
 using namespace std;
 
-bool no_bg = true;
-int numvecs = 0;
-set<string> vecnames;
-static bool errorflag = false;
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
-Netlist n;
+/* Exit code of a run that was stopped early by a budget or an interrupt */
+static const int EXIT_ABORTED = 2;
+
+/* Cancelled by SIGINT and SIGTERM when any budget is given */
+static CancelToken cancel_token;
+
+static void
+on_interrupt(int signum);
+
+static void
+print_usage();
+
+/* Options given on the command line */
+struct Options
+{
+    bool silent = false;
+    bool fork_jobs = false;
+    size_t jobs = 0;
+    double period = 0.0;
+    double threshold = BoundaryCondition::DEFAULT_BREAKPOINT_THRESHOLD;
+    double fourier_tolerance = 0.0;
+    BoundaryCondition::Interpolation interpolation = BoundaryCondition::LINEAR;
+    map<string, string> bc_files;
+    vector<string> save_vectors;
+    double window_cycles = 0.0;
+    string checkpoint_file;
+    bool resume = false;
+    string sweep_file;
+    int bench_alter = 0;
+    double foreground_cost = SpiceInstance::DEFAULT_FOREGROUND_COST;
+    int bench_run = 0;
+    int bench_bc = 0;
+    int bench_callback = 0;
+    size_t bc_cache = 0;
+    bool resample = false;
+    double progress_interval = 0.0;
+    double max_seconds = 0.0;
+    unsigned long max_steps = 0;
+    double stall_seconds = 0.0;
+    double points_per_cycle = 0.0;
+    unsigned long every = 1;
+    double last_cycles = 0.0;
+    double autotune_budget = 0.0;
+    vector<string> circuitfiles;
+};
+
+static bool
+budgeted(const Options &options);
+
+static int
+get_output_sampling(const Options &options, double period, OutputSampling &sampling);
+
+static int
+run_batch(const Options &options);
 
-int
-ng_getchar(char* outputreturn, int ident, void* userdata);
+static int
+resample_boundary_conditions(Netlist &netlist);
 
-int
-ng_getstat(char* outputreturn, int ident, void* userdata);
+static void
+print_save_report(const Netlist &netlist, SpiceInstance &spice);
 
-int
-ng_exit(int, bool, bool, int ident, void*);
+static int
+run_windowed(Netlist &netlist, SpiceInstance &spice, const Options &options);
 
-int
-ng_thread_runs(bool noruns, int ident, void* userdata);
+static int
+run_sweep(Netlist &netlist, SpiceInstance &spice, const Options &options);
 
-int
-ng_initdata(pvecinfoall intdata, int ident, void* userdata);
+static int
+bench_alter(Netlist &netlist, SpiceInstance &spice, int iterations);
 
-int
-ng_data(pvecvaluesall vdata, int numvecs, int ident, void* userdata);
+static int
+bench_run(SpiceInstance &spice, int iterations);
 
-int
-ng_getexternal(double* voltage, double t, char* node, int ident, void* userdata);
+static int
+bench_bc(const Options &options);
 
-int
-ciprefix(const char *p, const char *s);
+static int
+bench_callback(const Options &options);
+
+static int
+run_autotune(const Options &options);
 
 int main(int argc, char** argv)
 {
-    if (argc < 2) {
-        cout << "Usage: ./main <file.cir>" << endl;
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-s" || arg == "--silent") {
+            options.silent = true;
+        } else if (arg == "-f" || arg == "--fork") {
+            options.fork_jobs = true;
+        } else if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+        } else if ((arg == "-b" || arg == "--bc") && i + 1 < argc) {
+            string bc = argv[++i];
+            size_t eq = bc.find("=");
+            if (eq == string::npos) {
+                print_usage();
+                return 1;
+            }
+            options.bc_files[bc.substr(0, eq)] = bc.substr(eq + 1);
+        } else if ((arg == "-p" || arg == "--period") && i + 1 < argc) {
+            options.period = atof(argv[++i]);
+        } else if ((arg == "-k" || arg == "--breakpoints") && i + 1 < argc) {
+            options.threshold = atof(argv[++i]);
+        } else if ((arg == "-v" || arg == "--save") && i + 1 < argc) {
+            options.save_vectors.push_back(argv[++i]);
+        } else if (arg == "--fourier" && i + 1 < argc) {
+            options.fourier_tolerance = atof(argv[++i]);
+        } else if (arg == "--interpolate" && i + 1 < argc) {
+            string mode = argv[++i];
+            if (mode == "linear") {
+                options.interpolation = BoundaryCondition::LINEAR;
+            } else if (mode == "monotone") {
+                options.interpolation = BoundaryCondition::MONOTONE_CUBIC;
+            } else if (mode == "spline") {
+                options.interpolation = BoundaryCondition::PERIODIC_SPLINE;
+            } else {
+                print_usage();
+                return 1;
+            }
+        } else if ((arg == "-w" || arg == "--window") && i + 1 < argc) {
+            options.window_cycles = atof(argv[++i]);
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpoint_file = argv[++i];
+        } else if (arg == "--resume") {
+            options.resume = true;
+        } else if (arg == "--sweep" && i + 1 < argc) {
+            options.sweep_file = argv[++i];
+        } else if (arg == "--bench-alter" && i + 1 < argc) {
+            options.bench_alter = atoi(argv[++i]);
+        } else if (arg == "--foreground" && i + 1 < argc) {
+            options.foreground_cost = atof(argv[++i]);
+        } else if (arg == "--bench-run" && i + 1 < argc) {
+            options.bench_run = atoi(argv[++i]);
+        } else if (arg == "--bench-bc" && i + 1 < argc) {
+            options.bench_bc = atoi(argv[++i]);
+        } else if (arg == "--bc-cache" && i + 1 < argc) {
+            options.bc_cache = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--resample") {
+            options.resample = true;
+        } else if (arg == "--bench-callback" && i + 1 < argc) {
+            options.bench_callback = atoi(argv[++i]);
+        } else if (arg == "--progress" && i + 1 < argc) {
+            options.progress_interval = atof(argv[++i]);
+        } else if (arg == "--max-time" && i + 1 < argc) {
+            options.max_seconds = atof(argv[++i]);
+        } else if (arg == "--max-steps" && i + 1 < argc) {
+            options.max_steps = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--stall" && i + 1 < argc) {
+            options.stall_seconds = atof(argv[++i]);
+        } else if (arg == "--points-per-cycle" && i + 1 < argc) {
+            options.points_per_cycle = atof(argv[++i]);
+        } else if (arg == "--every" && i + 1 < argc) {
+            options.every = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--last-cycles" && i + 1 < argc) {
+            options.last_cycles = atof(argv[++i]);
+        } else if (arg == "--autotune" && i + 1 < argc) {
+            options.autotune_budget = atof(argv[++i]);
+        } else if (arg[0] == '-') {
+            print_usage();
+            return 1;
+        } else {
+            options.circuitfiles.push_back(arg);
+        }
+    }
+    BoundaryConditionCache::instance().set_capacity(options.bc_cache);
+    if (options.bench_bc > 0)
+        return bench_bc(options);
+    if (options.bench_callback > 0)
+        return bench_callback(options);
+    if (options.circuitfiles.empty()) {
+        print_usage();
         return 0;
     }
+    bool sampled = options.points_per_cycle > 0 || options.every > 1 || options.last_cycles > 0;
+    if (sampled && options.window_cycles > 0) {
+        cout << "Output sampling cannot be used with windowed runs." << endl;
+        return 1;
+    }
+    if ((options.resume || !options.checkpoint_file.empty()) && options.window_cycles <= 0) {
+        cout << "Checkpoints are taken between windows. Use -w <n>." << endl;
+        return 1;
+    }
+
+    // With a budget, an interrupt stops the runs and keeps their results so far
+    if (budgeted(options)) {
+        signal(SIGINT, on_interrupt);
+        signal(SIGTERM, on_interrupt);
+    }
+
+    if (options.autotune_budget > 0)
+        return run_autotune(options);
 
-    bool silent;
-    if (argc > 2) {
-        silent = (strcmp(argv[2], "-s") == 0 || strcmp(argv[2], "--silent") == 0);
+    // Several files, a pool size or fork mode: run them all without prompting for output
+    if (options.circuitfiles.size() > 1 || options.jobs > 0 || options.fork_jobs) {
+        if (options.jobs == 0) options.jobs = 1;
+        return run_batch(options);
     }
-    if (!silent) {
+
+    if (!options.silent) {
         cout << "Welcome to the command line LPN simulator" << endl;
         cout << "Print instructions? [y/n] ";
         string instructions;
@@ -87,63 +250,110 @@ int main(int argc, char** argv)
             cout << "Your file must be formatted with each line: <time> <value>, where time and value are doubles. The period " << endl;
             cout << "should be a double that states the length of the file in time (commonly 1.0)." << endl;
             cout << endl;
-            cout << "If you provide invalid files or period values, the behavior is undefined and the program may crash." << endl;
+            cout << "A file that cannot be read is reported with the line at fault. Invalid period values give undefined behavior." << endl;
             cout << endl;
         }
     }
 
     // Create a Netlist object for this file.
     // This will prompt the user to enter files for any
-    // external elements included in the file.
-    n = Netlist();
-    const string circuitfile = argv[1];
-    n.load_from_file(circuitfile);
+    // external elements not given on the command line.
+    Netlist n;
+    const string circuitfile = options.circuitfiles[0];
+    n.set_fourier_tolerance(options.fourier_tolerance);
+    n.set_interpolation(options.interpolation);
+    if (n.load_from_file(circuitfile, &options.bc_files, options.period) != 0)
+        return 1;
+    if (options.resample && resample_boundary_conditions(n) != 0)
+        return 1;
+    if (options.window_cycles <= 0)
+        n.add_save(options.save_vectors);
 
     int ret;
-    
+
     // Initialize Ngspice
-    ret = ngSpice_Init(ng_getchar, ng_getstat, ng_exit,  NULL, ng_initdata, ng_thread_runs, NULL);
-    ret = ngSpice_Init_Sync(ng_getexternal, ng_getexternal, NULL, NULL, NULL);
+    SpiceInstance spice(0);
+    ret = spice.init();
+    if (ret != 0) {
+        cout << "Could not initialize ngspice." << endl;
+        cout << "Exiting..." << endl;
+        return ret;
+    }
+    spice.set_breakpoint_threshold(options.threshold);
+    spice.set_foreground_cost(options.foreground_cost);
+    spice.set_time_budget(options.max_seconds);
+    spice.set_step_budget(options.max_steps);
+    spice.set_stall_timeout(options.stall_seconds);
+    if (budgeted(options)) spice.set_cancel_token(&cancel_token);
+    OutputSampling sampling;
+    if (get_output_sampling(options, n.get_max_period(), sampling) != 0)
+        return 1;
+    spice.set_output_sampling(sampling);
+
+    // Print sampled progress instead of every ngspice message
+    ProgressMonitor monitor(&spice, options.progress_interval);
+    if (options.progress_interval > 0)
+        spice.set_verbose(false);
+
+    if (options.window_cycles > 0) {
+        if (options.progress_interval > 0) monitor.start();
+        ret = run_windowed(n, spice, options);
+        monitor.stop();
+        return ret;
+    }
 
     // Load netlist
-    char **netlist_array = n.get_netlist();
-    if (netlist_array == NULL) {
+    ret = spice.load(&n);
+    if (ret != 0) {
         cout << "Error loading netlist from file." << endl;
         cout << "Check your file and try again." << endl;
         cout << "Exiting..." << endl;
         return 0;
     }
-    ret = ngSpice_Circ(netlist_array);
-    
-    // Run simulation
-    pthread_mutex_lock(&mutex);
-    ret = ngSpice_Command( (char*) "bg_run");
 
-    // Wait for background thread to start
-    while(no_bg) {
-        pthread_cond_wait(&cond, &mutex);
-    }
+    if (options.bench_alter > 0)
+        return bench_alter(n, spice, options.bench_alter);
+    if (options.bench_run > 0)
+        return bench_run(spice, options.bench_run);
+    if (!options.sweep_file.empty())
+        return run_sweep(n, spice, options);
+
+    // Run simulation
+    if (options.progress_interval > 0) monitor.start();
+    ret = spice.run();
+    monitor.stop();
+    int exit_code = (ret == SpiceInstance::ABORTED) ? EXIT_ABORTED : 0;
+    cout << spice.get_steps() << " time steps, " << spice.get_rejected_steps()
+        << " rejected" << endl;
+    if (!options.save_vectors.empty())
+        print_save_report(n, spice);
 
-    // Wait for background thread to exit
-    while(!no_bg) {
-        pthread_cond_wait(&cond, &mutex);
+    // Only the sampled points are held outside ngspice, so they are written here
+    if (sampling.enabled()) {
+        Results results;
+        spice.get_results(results);
+        ofstream out("out.raw");
+        results.write_table(out);
+        cout << "Kept " << (results.vectors.empty() ? 0 : results.vectors[0].data.size())
+            << " points of each vector; saved to out.raw" << endl;
+        cout << "Exiting..." << endl;
+        return out ? exit_code : 1;
     }
-    pthread_mutex_unlock(&mutex);
 
     /*
     * To customize this program, edit the code below. You likely want to use
-    * the function ngSpice_Command((char *)"your ngspice commmand here") to send
+    * the function spice.command("your ngspice commmand here") to send
     * regular ngspice commands. For a full description of how to use the shared
     * library API, check out chapter 19 of the Ngspice manual.
     */
 
     // Get vectors to save
-    if (silent) {
-        ret = ngSpice_Command((char*)"set filetype=ascii");
-        ret = ngSpice_Command((char*)"write out.raw");
+    if (options.silent) {
+        ret = spice.command("set filetype=ascii");
+        ret = spice.command("write out.raw");
         cout << "All vectors saved to out.raw" << endl;
         cout << "Exiting..." << endl;
-        return 0;
+        return exit_code;
     }
 
     string save;
@@ -156,10 +366,11 @@ int main(int argc, char** argv)
     }
     if (tolower(save[0]) == 'n') {
         cout << "Exiting without saving..." << endl;
-        return 0;
+        return exit_code;
     }
 
     cout << "Available vectors are: " << endl;
+    const set<string> &vecnames = spice.get_vector_names();
     for (string name : vecnames) {
         cout << name << endl;
     }
@@ -172,7 +383,7 @@ int main(int argc, char** argv)
         getline(cin, format);
     }
     if (tolower(format[0]) == 'a') {
-        ret = ngSpice_Command((char*)"set filetype=ascii");
+        ret = spice.command("set filetype=ascii");
         if (ret != 0) {
             cout << "Failed to set filetype to ASCII. Attempting to save in binary format.";
         }
@@ -190,11 +401,11 @@ int main(int argc, char** argv)
             cout << "Vector not avaliable. Enter valid vectors to save and enter a blank line when you're done." << endl;
             continue;
         }
-        command += vec;
+        command += " " + vec;
     }
 
     cout << "Saving vectors. This may take a moment..." << endl;
-    ret = ngSpice_Command(const_cast<char*>(command.c_str()));
+    ret = spice.command(command);
     if (ret == 0) {
         cout << "Vectors saved." << endl;
     } else {
@@ -203,117 +414,659 @@ int main(int argc, char** argv)
 
     cout << "Exiting..." << endl;
 
-    return ret;
+    return ret != 0 ? ret : exit_code;
 }
 
-/********************************************************************************
-NGSPICE CALLBACK FUNCTIONS
+/* Turn the output options into an OutputSampling, taking cycles to be the
+period given with -p or else the longest boundary condition period. Returns 0
+on success. */
+static int
+get_output_sampling(const Options &options, double period, OutputSampling &sampling)
+{
+    if (options.period > 0) period = options.period;
+    if ((options.points_per_cycle > 0 || options.last_cycles > 0) && period <= 0) {
+        cout << "Sampling by cycles needs a boundary condition period. Use -p <t>." << endl;
+        return 1;
+    }
+    if (options.points_per_cycle > 0)
+        sampling.step = period / options.points_per_cycle;
+    sampling.every = options.every > 1 ? options.every : 1;
+    sampling.last = options.last_cycles * period;
+    return 0;
+}
 
-The following functions are used as callbacks for the Ngspice background thread
-to communicate with the main thread of execution.
+/* Whether any run budget was given */
+static bool
+budgeted(const Options &options)
+{
+    return options.max_seconds > 0 || options.max_steps > 0 || options.stall_seconds > 0;
+}
 
-They are set using the calls to ngSpice_Init and ngSpice_InitSync above.
+/* Stop all runs that have the cancel token. Only stores an atomic, so it is
+safe in a signal handler. */
+static void
+on_interrupt(int signum)
+{
+    cancel_token.cancel();
+}
 
-Chapter 19 of the manual contains more information about these callbacks.
-*********************************************************************************/
+/* Print command line options */
+static void
+print_usage()
+{
+    cout << "Usage: ./simulator [options] <file.cir> [<file.cir> ...]" << endl;
+    cout << "  -s, --silent          save all vectors to out.raw without prompting" << endl;
+    cout << "  -j, --jobs <n>        run the circuit files on n parallel ngspice instances," << endl;
+    cout << "                        saving all vectors of <file.cir> to <file.cir>.raw" << endl;
+    cout << "  -f, --fork            run each circuit in a child process forked from one" << endl;
+    cout << "                        initialized ngspice, at most n at a time (with -j n)," << endl;
+    cout << "                        saving all vectors as ASCII columns to <file.cir>.raw" << endl;
+    cout << "  -b, --bc <elem>=<file> boundary condition file for external element <elem>" << endl;
+    cout << "                        (<elem> * for all); a table with a header naming its" << endl;
+    cout << "                        value columns gives each element the column of its name" << endl;
+    cout << "  -p, --period <t>      period of the boundary condition files" << endl;
+    cout << "  --bc-cache <n>        keep at most n boundary conditions read from file, dropping" << endl;
+    cout << "                        the least recently used (default 0 keeps all of them)" << endl;
+    cout << "  -k, --breakpoints <x> give ngspice a breakpoint wherever the slope of a boundary" << endl;
+    cout << "                        condition changes by at least x times its steepest slope" << endl;
+    cout << "                        (default 0.5; above 2 sets none)" << endl;
+    cout << "  --fourier <e>         replace each boundary condition table by the shortest" << endl;
+    cout << "                        Fourier series within e times the range of its values" << endl;
+    cout << "  --interpolate <mode>  interpolate boundary condition tables with linear (the" << endl;
+    cout << "                        default), monotone (monotone cubic) or spline (periodic" << endl;
+    cout << "                        cubic spline) segments" << endl;
+    cout << "  --resample            store the boundary conditions at every multiple of the" << endl;
+    cout << "                        .tran step in one period, and read them from there at" << endl;
+    cout << "                        those times (for runs with a fixed step)" << endl;
+    cout << "  -v, --save <vector>   keep only this vector in ngspice (repeatable), e.g." << endl;
+    cout << "                        -v \"v(2)\" -v \"i(v1)\"; the default keeps every vector" << endl;
+    cout << "  -w, --window <n>      run the transient analysis n boundary condition periods" << endl;
+    cout << "                        at a time, freeing ngspice memory between windows, and" << endl;
+    cout << "                        save the vectors as ASCII columns to out.raw" << endl;
+    cout << "  --checkpoint <file>   with -w, save the state of the run to file after every window" << endl;
+    cout << "  --resume              with -w and --checkpoint, continue a run that was stopped" << endl;
+    cout << "                        from its last checkpoint" << endl;
+    cout << "  --sweep <file>        run the circuit, then again for each line of file, changing" << endl;
+    cout << "                        the elements listed on it (<element>=<value> ...) with alter" << endl;
+    cout << "  --bench-alter <n>     time n reloads of the netlist against n alters of all of its" << endl;
+    cout << "                        R, C and L values, without simulating" << endl;
+    cout << "  --foreground <c>      run circuits with an estimated cost (output points times" << endl;
+    cout << "                        vectors) below c on the calling thread instead of the" << endl;
+    cout << "                        ngspice background thread (default 1e5; 0 never does)" << endl;
+    cout << "  --bench-run <n>       time n runs of the circuit in the foreground against n runs" << endl;
+    cout << "                        in the ngspice background thread" << endl;
+    cout << "  --bench-bc <n>        time n transient runs' worth of lookups in each -b file" << endl;
+    cout << "                        with a tree, a binary search and a cursor (needs -p)" << endl;
+    cout << "  --bench-callback <n>  time n transient runs' worth of external source callbacks" << endl;
+    cout << "                        for the circuit, finding sources by name and by handle" << endl;
+    cout << "  --progress <s>        print the percent done, simulation time and step counts" << endl;
+    cout << "                        every s seconds instead of every ngspice message" << endl;
+    cout << "  --max-time <s>        stop each run after s seconds of wall clock time" << endl;
+    cout << "  --max-steps <n>       stop each run after n time steps" << endl;
+    cout << "  --stall <s>           stop a run if ngspice takes no time step for s seconds" << endl;
+    cout << "                        With any of these, runs stopped early (or by Ctrl-C) keep" << endl;
+    cout << "                        their results so far, and the exit code is 2" << endl;
+    cout << "  --points-per-cycle <n> keep only n points per boundary condition period, linearly" << endl;
+    cout << "                        interpolated from the time steps as they are computed" << endl;
+    cout << "  --every <k>           keep only every k-th time step" << endl;
+    cout << "  --last-cycles <n>     keep only the last n periods of the run" << endl;
+    cout << "                        With any of these, the kept points are saved as ASCII" << endl;
+    cout << "                        columns to out.raw (or <file.cir>.raw in batch runs)" << endl;
+    cout << "  --autotune <e>        try integration options on one-period pilot runs (on n" << endl;
+    cout << "                        instances with -j n) and save the circuit with the fastest" << endl;
+    cout << "                        options within relative error e of a reference run to" << endl;
+    cout << "                        <file>_tuned.cir" << endl;
+}
 
-/* Transfer any string created by printf or puts. 
-Output to stdout in ngspice is preceded by token stdout, same with stderr. */
-int
-ng_getchar(char* outputreturn, int ident, void* userdata)
+/* Choose solver options for the circuit with pilot runs on a pool of
+options.jobs instances, and write the circuit with them to <file>_tuned.cir */
+static int
+run_autotune(const Options &options)
 {
-    printf("%s\n", outputreturn);
-    /* setting a flag if an error message occurred */
-    if (ciprefix("stderr Error:", outputreturn))
-        errorflag = true;
+    const string &circuitfile = options.circuitfiles[0];
+    Netlist netlist;
+    netlist.set_fourier_tolerance(options.fourier_tolerance);
+    netlist.set_interpolation(options.interpolation);
+    if (netlist.load_from_file(circuitfile, &options.bc_files, options.period) != 0)
+        return 1;
+    double period = options.period > 0 ? options.period : netlist.get_max_period();
+
+    SpicePool pool(options.jobs > 0 ? options.jobs : 1);
+    pool.set_breakpoint_threshold(options.threshold);
+    pool.set_foreground_cost(options.foreground_cost);
+    pool.set_budgets(options.max_seconds, options.max_steps, options.stall_seconds,
+        budgeted(options) ? &cancel_token : NULL);
+    if (pool.init() != 0) {
+        cout << "Could not initialize ngspice." << endl;
+        return 1;
+    }
+
+    Autotuner tuner(&pool);
+    if (tuner.tune(netlist, period, options.autotune_budget) != 0)
+        return 1;
+
+    size_t dot = circuitfile.rfind('.');
+    string tuned = circuitfile.substr(0, dot) + "_tuned" +
+        (dot == string::npos ? ".cir" : circuitfile.substr(dot));
+    if (netlist.write_to_file(tuned) != 0) {
+        cout << "Error: could not write " << tuned << endl;
+        return 1;
+    }
+    cout << "Tuned circuit saved to " << tuned << endl;
     return 0;
 }
 
+/* Run the loaded circuit once as given, then once for each line of the sweep
+file. A line lists changes as <element>=<value>, <element>.<parameter>=<value>
+or model:<model>.<parameter>=<value>, separated by spaces, and each change
+stays in effect for later lines. Changes are applied with alter and altermod,
+so the circuit is parsed only once. Point k is written to <file.cir>.<k>.raw. */
+static int
+run_sweep(Netlist &netlist, SpiceInstance &spice, const Options &options)
+{
+    ifstream sweep(options.sweep_file);
+    if (!sweep) {
+        cout << "Error: could not open " << options.sweep_file << endl;
+        return 1;
+    }
+
+    string line;
+    int failed = 0;
+    int stopped = 0;
+    for (int point = 0; ; point++) {
+        vector<ParameterChange> changes;
+        if (point > 0) {
+            if (!getline(sweep, line)) break;
+            istringstream specs(line);
+            string spec;
+            while (specs >> spec) {
+                ParameterChange change;
+                if (ParameterChange::parse(spec, change) != 0) {
+                    cout << "Error: invalid change " << spec << " on line " << point << endl;
+                    return 1;
+                }
+                changes.push_back(change);
+            }
+            if (changes.empty()) continue;
+        }
+
+        auto start = chrono::steady_clock::now();
+        int ret = spice.alter(changes);
+        auto altered = chrono::steady_clock::now();
+        if (ret == 0) ret = (point == 0) ? spice.run() : spice.rerun();
+        auto finished = chrono::steady_clock::now();
 
-/* Transfer status messages */
-int
-ng_getstat(char* outputreturn, int ident, void* userdata)
+        // A point stopped early is saved as far as it got, and does not stop the sweep
+        bool aborted = (ret == SpiceInstance::ABORTED);
+        if (aborted) {
+            ret = 0;
+            stopped++;
+        }
+        Results results;
+        if (ret == 0) ret = spice.get_results(results);
+        ostringstream filename;
+        filename << options.circuitfiles[0] << "." << point << ".raw";
+        if (ret == 0) {
+            ofstream out(filename.str());
+            results.write_table(out);
+            if (!out) ret = 1;
+        }
+        if (ret != 0) {
+            failed++;
+            cout << "Point " << point << " failed." << endl;
+            continue;
+        }
+        cout << "Point " << point << (aborted ? " (stopped early)" : "") << ": altered in "
+            << chrono::duration<double, milli>(altered - start).count() << " ms, ran in "
+            << chrono::duration<double, milli>(finished - altered).count() << " ms, saved to "
+            << filename.str() << endl;
+    }
+    if (failed > 0) return 1;
+    return stopped > 0 ? EXIT_ABORTED : 0;
+}
+
+/* Compare the cost of changing element values by loading the whole netlist
+again against changing them with alter. Every resistor, capacitor and inductor
+is altered to its current value, so the circuit does not change. Nothing is
+simulated. */
+static int
+bench_alter(Netlist &netlist, SpiceInstance &spice, int iterations)
 {
-    printf("%s\n", outputreturn);
+    vector<ParameterChange> changes;
+    for (auto const& element : netlist.get_element_values()) {
+        ParameterChange change;
+        change.name = element.first;
+        change.value = element.second;
+        changes.push_back(change);
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        spice.clear();
+        if (spice.load(&netlist) != 0) {
+            cout << "Error loading netlist." << endl;
+            return 1;
+        }
+    }
+    auto reparsed = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        if (spice.alter(changes) != 0) return 1;
+    }
+    auto altered = chrono::steady_clock::now();
+
+    double reparse_ms = chrono::duration<double, milli>(reparsed - start).count() / iterations;
+    double alter_ms = chrono::duration<double, milli>(altered - reparsed).count() / iterations;
+    cout << "Reparse: " << reparse_ms << " ms per load" << endl;
+    cout << "Alter:   " << alter_ms << " ms per update of " << changes.size() << " elements" << endl;
+    if (alter_ms > 0)
+        cout << "Alter is " << reparse_ms / alter_ms << " times faster" << endl;
     return 0;
 }
 
-/* Called when the bg thread starts/stops running */
-int
-ng_thread_runs(bool noruns, int ident, void* userdata)
-{   
-    pthread_mutex_lock(&mutex);
-    no_bg = noruns;
-    if (noruns) {
-        pthread_cond_signal(&cond);
-        printf("bg not running\n");
-    } else {
-        pthread_cond_signal(&cond);
-        printf("bg running\n");
+/* Compare the latency of running the loaded circuit on the calling thread
+against running it in the ngspice background thread, which adds a thread start
+and a wait for it to stop to every run */
+static int
+bench_run(SpiceInstance &spice, int iterations)
+{
+    const SpiceInstance::RunMode modes[] = {
+        SpiceInstance::RUN_FOREGROUND, SpiceInstance::RUN_BACKGROUND };
+    const char *names[] = { "Foreground", "Background" };
+    double mean_ms[2];
+
+    spice.set_verbose(false);
+    for (int m = 0; m < 2; m++) {
+        spice.set_run_mode(modes[m]);
+        double min_ms = 0.0, max_ms = 0.0, total_ms = 0.0;
+        for (int i = 0; i < iterations; i++) {
+            auto start = chrono::steady_clock::now();
+            if (spice.rerun() != 0) {
+                cout << "Error running circuit." << endl;
+                return 1;
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            total_ms += ms;
+            if (i == 0 || ms < min_ms) min_ms = ms;
+            if (i == 0 || ms > max_ms) max_ms = ms;
+        }
+        mean_ms[m] = total_ms / iterations;
+        cout << names[m] << ": " << mean_ms[m] << " ms per run (min " << min_ms
+            << ", max " << max_ms << ")" << endl;
     }
-    pthread_mutex_unlock(&mutex);
+    if (mean_ms[0] > 0)
+        cout << "Foreground is " << mean_ms[1] / mean_ms[0] << " times faster" << endl;
     return 0;
 }
 
-
-/* Called from bg thread in ngspice once upon intialization
-   of the simulation vectors)*/
-int
-ng_initdata(pvecinfoall intdata, int ident, void* userdata)
+/* Compare ways of looking up boundary condition values along the time steps
+of a transient run: the std::map the tables used to be kept in, a binary
+search of the sorted arrays, a cursor moving along them and, for evenly
+spaced files, index arithmetic; and for tables of several columns, finding
+each column on its own against all of them at once. Every 50th step is redone
+from half a step back, as ngspice does after rejecting a step. */
+static int
+bench_bc(const Options &options)
 {
-    numvecs = intdata->veccount;
-    for (int i = 0; i < numvecs; i++) {
-        printf("Vector: %s\n", intdata->vecs[i]->vecname);
-        vecnames.insert(intdata->vecs[i]->vecname);
+    if (options.bc_files.empty() || options.period <= 0) {
+        cout << "Give the boundary condition files with -b and their period with -p." << endl;
+        return 1;
+    }
+
+    for (auto const& file : options.bc_files) {
+        BoundaryCondition bc(file.second, options.period, 0.0, options.interpolation);
+        const vector<double> &times = bc.get_times();
+        const vector<double> &values = bc.get_values();
+        if (times.empty()) {
+            cout << file.second << ": no points" << endl;
+            continue;
+        }
+        map<double, double> tree;
+        for (size_t i = 0; i < times.size(); i++)
+            tree[times[i]] = values[i];
+
+        // ten periods at a step four times finer than the file
+        vector<double> steps;
+        double dt = options.period / (4.0 * times.size());
+        for (double t = 0; t < 10 * options.period; t += dt) {
+            steps.push_back(t);
+            if (steps.size() % 50 == 0) steps.push_back(t - dt / 2);
+        }
+
+        double sums[4] = { 0.0, 0.0, 0.0, 0.0 };
+        double ns[4];
+        int methods = bc.is_uniform() ? 4 : 3;
+        for (int method = 0; method < methods; method++) {
+            bc.set_uniform_lookup(method == 3);
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < options.bench_bc; i++) {
+                BoundaryCondition::Cursor cursor;
+                for (double t : steps) {
+                    if (method == 0) {
+                        double phase = fmod(t, options.period);
+                        auto high = tree.lower_bound(phase);
+                        if (high == tree.end()) --high;
+                        auto low = (high == tree.begin() ? high : prev(high));
+                        sums[0] += (high->first == low->first) ? high->second :
+                            low->second + (phase - low->first) * (high->second - low->second)
+                            / (high->first - low->first);
+                    } else if (method == 1) {
+                        sums[1] += bc.get_state(t);
+                    } else {
+                        sums[method] += bc.get_state(t, cursor);
+                    }
+                }
+            }
+            double total = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+            ns[method] = total / (static_cast<double>(options.bench_bc) * steps.size());
+        }
+
+        cout << file.first << " (" << times.size() << " points, " << steps.size()
+            << " lookups per run):" << endl;
+        cout << "  std::map:      " << ns[0] << " ns per lookup" << endl;
+        cout << "  Binary search: " << ns[1] << " ns per lookup" << endl;
+        cout << "  Cursor:        " << ns[2] << " ns per lookup" << endl;
+        if (methods == 4)
+            cout << "  Uniform grid:  " << ns[3] << " ns per lookup" << endl;
+        int best = methods - 1;
+        if (ns[best] > 0)
+            cout << "  " << (best == 3 ? "Uniform grid" : "Cursor") << " is " << ns[0] / ns[best]
+                << " times faster than std::map" << endl;
+        if (sums[1] != sums[2])
+            cout << "  Cursor and binary search disagree!" << endl;
+        if (methods == 4 && abs(sums[3] - sums[1]) > 1e-9 * abs(sums[1]))
+            cout << "  Uniform grid and binary search disagree!" << endl;
+
+        // a table of several columns: one lookup per column, or all at once
+        size_t columns = bc.get_columns();
+        if (columns > 1) {
+            vector<double> states(columns);
+            double column_ns[2];
+            for (int together = 0; together < 2; together++) {
+                auto start = chrono::steady_clock::now();
+                for (int i = 0; i < options.bench_bc; i++) {
+                    BoundaryCondition::Cursor cursor;
+                    for (double t : steps) {
+                        if (together) {
+                            bc.get_states(t, cursor, states.data());
+                        } else {
+                            for (size_t c = 0; c < columns; c++)
+                                states[c] = bc.get_state(t, cursor, c);
+                        }
+                        sums[0] += states[columns - 1];
+                    }
+                }
+                double total = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+                column_ns[together] = total / (static_cast<double>(options.bench_bc) * steps.size());
+            }
+            cout << "  All " << columns << " columns: " << column_ns[0] << " ns per time one by one, "
+                << column_ns[1] << " ns together" << endl;
+        }
     }
     return 0;
 }
 
+/* Resample the boundary conditions of the netlist onto the step of its .tran
+line. Returns 1 if it has none. */
+static int
+resample_boundary_conditions(Netlist &netlist)
+{
+    double step, stop;
+    bool uic;
+    if (netlist.get_transient(step, stop, uic) != 0 || step <= 0) {
+        cout << "--resample needs a .tran line with a step." << endl;
+        return 1;
+    }
+    int resampled = netlist.resample_boundary_conditions(step);
+    cout << "Resampled " << resampled << " boundary condition table(s) onto a step of " << step << endl;
+    return 0;
+}
 
-/* Callback function called from bg thread in ngspice if fcn controlled_exit()
-   is hit. Do not exit, but unload ngspice. TODO: Is this right? */
-int
-ng_exit(int exitstatus, bool immediate, bool quitexit, int ident, void* userdata)
+/* Time the lookups the external source callbacks make over a transient run
+of the first circuit: three Newton iterations per step, each asking for every
+external source. Sources are found by building a string of the name ngspice
+passes and looking it up in the netlist, as the callbacks used to, or by a
+SourceHandles table resolving the address of the name once, and then with the
+boundary conditions resampled onto the step as well. ngspice keeps the names
+in its copy of the circuit, so the benchmark keeps copies of its own. */
+static int
+bench_callback(const Options &options)
 {
+    if (options.circuitfiles.empty()) {
+        print_usage();
+        return 1;
+    }
+    Netlist netlist;
+    netlist.set_interactive(false);
+    netlist.set_interpolation(options.interpolation);
+    if (netlist.load_from_file(options.circuitfiles[0], &options.bc_files, options.period) != 0)
+        return 1;
 
-    if(quitexit) {
-        printf("DNote: Returned form quit with exit status %d\n", exitstatus);
-        exit(exitstatus);
+    vector<string> elements = netlist.get_external_elements();
+    if (elements.empty()) {
+        cout << options.circuitfiles[0] << " has no external sources." << endl;
+        return 1;
     }
-    if(immediate) {
-        printf("DNote: Unloading ngspice inmmediately is not possible\n");
-        printf("DNote: Can we recover?\n");
+    vector<vector<char> > copies;
+    for (auto const& element : elements)
+        copies.push_back(vector<char>(element.c_str(), element.c_str() + element.length() + 1));
+    vector<char*> names;
+    for (auto &copy : copies)
+        names.push_back(copy.data());
+
+    double step, stop;
+    bool uic;
+    if (netlist.get_transient(step, stop, uic) != 0 || step <= 0 || stop <= step) {
+        stop = 10 * netlist.get_max_period();
+        step = stop / 10000;
     }
+    size_t steps = static_cast<size_t>(stop / step);
 
-    else {
-        printf("DNote: Unloading ngspice is not possible\n");
-        printf("DNote: Can we recover? Send 'quit' command to ngspice.\n");
-        errorflag = true;
-        ngSpice_Command( (char*) "quit 5");
+    const int iterations = 3;
+    double sums[3] = { 0.0, 0.0, 0.0 };
+    double ns[3];
+    for (int method = 0; method < 3; method++) {
+        if (method == 2)
+            netlist.resample_boundary_conditions(step);
+        SourceHandles handles;
+        handles.reset(&netlist);
+        auto start = chrono::steady_clock::now();
+        for (int run = 0; run < options.bench_callback; run++) {
+            for (size_t k = 0; k < steps; k++) {
+                double t = k * step;
+                for (int iteration = 0; iteration < iterations; iteration++) {
+                    for (char *name : names) {
+                        if (method == 0)
+                            sums[0] += netlist.get_boundary_condition(name, t);
+                        else
+                            sums[method] += netlist.get_source_state(handles.resolve(name), t);
+                    }
+                }
+            }
+        }
+        double total = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        ns[method] = total / (static_cast<double>(options.bench_callback) * steps * iterations
+            * names.size());
     }
 
-    return exitstatus;
+    cout << names.size() << " external sources, " << steps << " steps of " << iterations
+        << " iterations per run:" << endl;
+    cout << "  By name:   " << ns[0] << " ns per callback" << endl;
+    cout << "  By handle: " << ns[1] << " ns per callback" << endl;
+    cout << "  Resampled: " << ns[2] << " ns per callback" << endl;
+    if (ns[1] > 0)
+        cout << "  Handles are " << ns[0] / ns[1] << " times faster" << endl;
+    if (ns[2] > 0)
+        cout << "  Resampled handles are " << ns[0] / ns[2] << " times faster" << endl;
+    if (sums[0] != sums[1])
+        cout << "  By name and by handle disagree!" << endl;
+    // resampled states are read at times a rounding error from those interpolated
+    if (fabs(sums[2] - sums[1]) > 1e-9 * (fabs(sums[1]) + 1.0))
+        cout << "  Resampled and interpolated states disagree!" << endl;
+    return 0;
 }
 
-/* Called when the simulation needs a value from an external element */
-int
-ng_getexternal(double* voltage, double t, char* node, int ident, void* userdata)
-{   
-    *voltage = n.get_boundary_condition(node, t);
+/* Run the netlist in windows of options.window_cycles periods, writing the
+results to out.raw as they are produced, and a checkpoint after each window
+if options.checkpoint_file is set. With options.resume, continue from the
+checkpoint instead. */
+static int
+run_windowed(Netlist &netlist, SpiceInstance &spice, const Options &options)
+{
+    double period = options.period > 0 ? options.period : netlist.get_max_period();
+    if (period <= 0) {
+        cout << "Windowed runs need a boundary condition period. Use -p <t>." << endl;
+        return 1;
+    }
+
+    // A resumed run drops any output written after its checkpoint, and appends to the rest
+    Checkpoint checkpoint;
+    ofstream out;
+    if (options.resume) {
+        if (options.checkpoint_file.empty() || checkpoint.read(options.checkpoint_file) != 0) {
+            cout << "Could not read a checkpoint to resume from. Use --checkpoint <file>." << endl;
+            return 1;
+        }
+        if (truncate("out.raw", checkpoint.output_offset) != 0) {
+            cout << "Could not truncate out.raw to the checkpoint." << endl;
+            return 1;
+        }
+        out.open("out.raw", ios::app);
+    } else {
+        out.open("out.raw");
+    }
+
+    WindowedRun windowed(&spice);
+    windowed.set_checkpoint_file(options.checkpoint_file);
+    int ret = windowed.run(netlist, options.window_cycles * period, out, options.save_vectors,
+        options.resume ? &checkpoint : NULL);
+    if (ret == SpiceInstance::ABORTED) {
+        cout << "Vectors so far saved to out.raw" << endl;
+        cout << "Exiting..." << endl;
+        return EXIT_ABORTED;
+    }
+    if (ret != 0) {
+        cout << "Exiting..." << endl;
+        return ret;
+    }
+    cout << "Vectors saved to out.raw" << endl;
+    cout << "Exiting..." << endl;
     return 0;
 }
 
-/* Case insensitive prefix. */
-int
-ciprefix(const char *p, const char *s)
+/* Print how much memory keeping only the vectors given with -v saved, compared
+to the estimated number of vectors ngspice would otherwise keep */
+static void
+print_save_report(const Netlist &netlist, SpiceInstance &spice)
 {
-    while (*p) {
-        if ((isupper(*p) ? tolower(*p) : *p) !=
-            (isupper(*s) ? tolower(*s) : *s))
-            return(false);
-        p++;
-        s++;
-    }
-    return (true);
+    size_t kept = spice.get_vector_count();
+    size_t all = netlist.estimate_vector_count();
+    if (all < kept) all = kept;
+    size_t points = spice.get_vector_length("time");
+    double mb = points * sizeof(double) / (1024.0 * 1024.0);
+    streamsize precision = cout.precision(3);
+    cout << "Kept " << kept << " of about " << all << " vectors";
+    if (points > 0) {
+        cout << " at " << points << " time points: " << kept * mb << " MB instead of "
+            << all * mb << " MB";
+    }
+    cout << " (" << (int) (100.0 * (all - kept) / all + 0.5) << "% less)" << endl;
+    cout.precision(precision);
 }
 
+/* Run each circuit file on a pool of ngspice instances, or in children of a
+fork server. Netlists are loaded up front, so any prompts for boundary
+conditions happen before the jobs start, and files given to several circuits
+are read only once. */
+static int
+run_batch(const Options &options)
+{
+    BoundaryConditionFiles shared;
+    vector<Netlist*> netlists;
+    vector<SpiceJob> batch;
+    for (const string &file : options.circuitfiles) {
+        Netlist *netlist = new Netlist();
+        netlist->set_fourier_tolerance(options.fourier_tolerance);
+        netlist->set_interpolation(options.interpolation);
+        netlists.push_back(netlist);
+        if (netlist->load_from_file(file, &options.bc_files, options.period, &shared) != 0) {
+            for (Netlist *loaded : netlists)
+                delete loaded;
+            return 1;
+        }
+        if (options.resample && resample_boundary_conditions(*netlist) != 0) {
+            for (Netlist *loaded : netlists)
+                delete loaded;
+            return 1;
+        }
+        netlist->add_save(options.save_vectors);
+
+        SpiceJob job;
+        job.netlist = netlist;
+        job.output_file = file + ".raw";
+        job.status = 0;
+        batch.push_back(job);
+    }
+    BoundaryConditionCache &cache = BoundaryConditionCache::instance();
+    if (cache.get_hits() + cache.get_misses() > 0) {
+        cout << "Boundary conditions: " << cache.get_misses() << " read from file, "
+            << cache.get_hits() << " reused" << endl;
+    }
+
+    OutputSampling sampling;
+    if (get_output_sampling(options, netlists[0]->get_max_period(), sampling) != 0) {
+        for (Netlist *netlist : netlists)
+            delete netlist;
+        return 1;
+    }
+
+    int failed = 0;
+    int ret;
+    if (options.fork_jobs) {
+        SpiceInstance spice(0);
+        spice.set_verbose(false);
+        spice.set_breakpoint_threshold(options.threshold);
+        spice.set_foreground_cost(options.foreground_cost);
+        spice.set_time_budget(options.max_seconds);
+        spice.set_step_budget(options.max_steps);
+        spice.set_stall_timeout(options.stall_seconds);
+        if (budgeted(options)) spice.set_cancel_token(&cancel_token);
+        spice.set_output_sampling(sampling);
+        ret = spice.init();
+        if (ret == 0) {
+            cout << "Running " << batch.size() << " circuits in forked children, "
+                << options.jobs << " at a time..." << endl;
+            ForkServer server(&spice);
+            failed = server.run(batch, options.jobs);
+        }
+    } else {
+        SpicePool pool(options.jobs);
+        pool.set_breakpoint_threshold(options.threshold);
+        pool.set_foreground_cost(options.foreground_cost);
+        ret = pool.init();
+        pool.set_budgets(options.max_seconds, options.max_steps, options.stall_seconds,
+            budgeted(options) ? &cancel_token : NULL);
+        pool.set_output_sampling(sampling);
+        if (ret == 0) {
+            cout << "Running " << batch.size() << " circuits on " << pool.size()
+                << " ngspice instances..." << endl;
+            failed = pool.run(batch);
+        }
+    }
+    if (ret != 0) {
+        cout << "Could not initialize ngspice." << endl;
+    } else {
+        cout << batch.size() - failed << " of " << batch.size() << " circuits finished." << endl;
+    }
+
+    size_t stopped = 0;
+    for (const SpiceJob &job : batch) {
+        if (job.status == SpiceInstance::ABORTED) stopped++;
+    }
+    if (stopped > 0)
+        cout << stopped << " circuits were stopped early; their output is partial." << endl;
+
+    for (Netlist *netlist : netlists)
+        delete netlist;
+    if (ret != 0 || failed > (int) stopped) return 1;
+    return stopped > 0 ? EXIT_ABORTED : 0;
+}
@@ -5,21 +5,75 @@ Implement netlist class
 */
 
 #include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <set>
 #include <string.h>
+#include <stdlib.h>
 #include "netlist.h"
+#include "boundaryconditioncache.h"
+
+// Fraction of a step within which a time is taken to be on the resampled grid
+static const double GRID_TOLERANCE = 1e-6;
+
+/* Return the first token of a netlist line in lowercase, so that control
+lines such as .TRAN are found whatever their case, and .op is not taken for
+.options */
+static std::string
+card_name(const std::string &line)
+{
+    std::istringstream tokens(line);
+    std::string name;
+    tokens >> name;
+    for (size_t i = 0; i < name.length(); i++)
+        name[i] = std::tolower(static_cast<unsigned char>(name[i]));
+    return name;
+}
 
 Netlist::Netlist(const std::string &name)
 {
 	this->netlist = NULL;
 	this->file_loaded = false;
 	this->constructed = false;
+	this->interactive = true;
+	this->fourier_tolerance = 0.0;
+	this->interpolation = BoundaryCondition::LINEAR;
+}
+
+Netlist::Netlist(const Netlist &other)
+{
+	this->netlist = NULL;
+	this->constructed = false;
+	*this = other;
+}
+
+Netlist &Netlist::operator=(const Netlist &other)
+{
+	if (this == &other) return *this;
+	this->free_netlist();
+	this->sources = other.sources;
+	this->source_index = other.source_index;
+	// the copy may run in another thread, so it gets its own table states
+	std::map<const TableState*, std::shared_ptr<TableState> > tables;
+	for (auto &source : this->sources) {
+		std::shared_ptr<TableState> &table = tables[source.table.get()];
+		if (!table) {
+			table = std::make_shared<TableState>(*source.table);
+			table->time = NAN;
+		}
+		source.table = table;
+	}
+	this->netlist_vec = other.netlist_vec;
+	this->file_loaded = other.file_loaded;
+	this->interactive = other.interactive;
+	this->fourier_tolerance = other.fourier_tolerance;
+	this->interpolation = other.interpolation;
+	return *this;
 }
 
 Netlist::~Netlist()
 {
-	for (auto const& val : bcs)
-		delete val.second;
-	
 	if(!this->netlist) return;
 	
 	this->unload_netlist();
@@ -28,12 +82,43 @@ Netlist::~Netlist()
 int Netlist::load_from_file(
 	const std::string &filename, 
 	const std::map<std::string,std::string>* bc_files,
-	const double period
+	const double period,
+	BoundaryConditionFiles* shared
 )
 {
 	this->unload_netlist();
 	// open file
 	std::ifstream f(filename);
+	if (!f) {
+		std::cout << "Error: could not open " << filename << std::endl;
+		return 1;
+	}
+	return this->load(f, bc_files, period, shared);
+}
+
+int Netlist::load_from_string(
+	const std::string &text, 
+	const std::map<std::string,std::string>* bc_files,
+	const double period,
+	BoundaryConditionFiles* shared
+)
+{
+	this->unload_netlist();
+	std::istringstream f(text);
+	return this->load(f, bc_files, period, shared);
+}
+
+int Netlist::load(
+	std::istream &f, 
+	const std::map<std::string,std::string>* bc_files,
+	const double period,
+	BoundaryConditionFiles* shared
+)
+{
+	int ret = 0;
+	// tables given at a prompt are offered to the elements after
+	BoundaryConditionFiles files;
+	if (!shared) shared = &files;
     char line[256];
     while(true) {
         // read file
@@ -46,9 +131,11 @@ int Netlist::load_from_file(
         	std::string elem_name = l.substr(0, l.find(" "));
         	
         	if (bc_files && bc_files->find(elem_name) != bc_files->end()) {
-        		this->add_boundary_condition(elem_name, bc_files->at(elem_name), period);
+        		ret |= this->add_boundary_condition(elem_name, bc_files->at(elem_name), period, shared);
+        	} else if (bc_files && bc_files->find("*") != bc_files->end()) {
+        		ret |= this->add_boundary_condition(elem_name, bc_files->at("*"), period, shared);
         	} else {
-        		this->add_boundary_condition(elem_name);
+        		ret |= this->add_boundary_condition(elem_name, "", 0.0, shared);
         	}
         }
 
@@ -58,41 +145,305 @@ int Netlist::load_from_file(
     }
 
     this->file_loaded = true;
-	return 0;
+	return ret;
+}
+
+void Netlist::set_analysis(const std::string &line)
+{
+	for (size_t i = 0; i < this->netlist_vec.size(); i++) {
+		std::string card = card_name(this->netlist_vec[i]);
+		if (card == ".tran" || card == ".dc" || card == ".ac" || card == ".op") {
+			this->netlist_vec[i] = line;
+			return;
+		}
+	}
+	this->netlist_vec.push_back(line);
+}
+
+void Netlist::add_save(const std::vector<std::string> &vectors)
+{
+	if (vectors.empty()) return;
+	std::string line = ".save";
+	for (const std::string &vec : vectors)
+		line += " " + vec;
+	this->netlist_vec.push_back(line);
+}
+
+size_t Netlist::estimate_vector_count() const
+{
+	std::set<std::string> nodes;
+	std::vector<std::string> branches;
+	this->find_nodes(nodes, branches);
+	return 1 + nodes.size() + branches.size();
+}
+
+double Netlist::estimate_run_cost() const
+{
+	double step, stop;
+	bool uic;
+	if (this->get_transient(step, stop, uic) != 0 || step <= 0 || stop <= 0)
+		return 0.0;
+	return (stop / step + 1) * this->estimate_vector_count();
+}
+
+std::vector<std::string> Netlist::get_state_vectors() const
+{
+	std::set<std::string> nodes;
+	std::vector<std::string> branches;
+	this->find_nodes(nodes, branches);
+
+	std::vector<std::string> vectors;
+	for (const std::string &node : nodes)
+		vectors.push_back("v(" + node + ")");
+	for (const std::string &element : branches) {
+		if (element[0] == 'l') vectors.push_back(element + "#branch");
+	}
+	return vectors;
+}
+
+void Netlist::set_initial_conditions(const std::map<std::string, double> &node_voltages,
+	const std::map<std::string, double> &inductor_currents)
+{
+	std::vector<std::string> lines;
+	std::ostringstream ic;
+	ic.precision(17);
+	ic << ".ic";
+	for (auto const& node : node_voltages)
+		ic << " v(" << node.first << ")=" << node.second;
+
+	for (const std::string &line : this->netlist_vec) {
+		if (card_name(line) == ".ic") continue;
+
+		std::istringstream tokens(line);
+		std::string name;
+		tokens >> name;
+		std::string lower(name);
+		for (size_t i = 0; i < lower.length(); i++)
+			lower[i] = std::tolower(lower[i]);
+		auto current = inductor_currents.find(lower);
+		if (lower.empty() || lower[0] != 'l' || current == inductor_currents.end()) {
+			lines.push_back(line);
+			continue;
+		}
+
+		// Rewrite the inductor line without any previous ic=
+		std::ostringstream inductor;
+		inductor.precision(17);
+		inductor << name;
+		std::string token;
+		while (tokens >> token) {
+			if (token.compare(0, 3, "ic=") != 0 && token.compare(0, 3, "IC=") != 0)
+				inductor << " " << token;
+		}
+		inductor << " ic=" << current->second;
+		lines.push_back(inductor.str());
+	}
+	if (!node_voltages.empty())
+		lines.push_back(ic.str());
+	this->netlist_vec = lines;
+}
+
+void Netlist::set_options(const std::string &line)
+{
+	std::vector<std::string> lines;
+	bool replaced = false;
+	for (const std::string &l : this->netlist_vec) {
+		std::string card = card_name(l);
+		if (card == ".options" || card == ".option") {
+			if (!replaced) lines.push_back(line);
+			replaced = true;
+		} else {
+			lines.push_back(l);
+		}
+	}
+	if (!replaced) lines.push_back(line);
+	this->netlist_vec = lines;
+}
+
+int Netlist::write_to_file(const std::string &filename) const
+{
+	std::ofstream out(filename);
+	for (const std::string &line : this->netlist_vec)
+		out << line << "\n";
+	out << ".end" << std::endl;
+	return out ? 0 : 1;
+}
+
+std::map<std::string, std::string> Netlist::get_element_values() const
+{
+	std::map<std::string, std::string> values;
+	for (size_t i = 1; i < this->netlist_vec.size(); i++) {
+		std::istringstream line(this->netlist_vec[i]);
+		std::string name, node_in, node_out, value;
+		if (!(line >> name >> node_in >> node_out >> value)) continue;
+		char type = std::tolower(name[0]);
+		if (type == 'r' || type == 'c' || type == 'l')
+			values[name] = value;
+	}
+	return values;
+}
+
+int Netlist::get_transient(double &step, double &stop, bool &uic) const
+{
+	for (const std::string &line : this->netlist_vec) {
+		if (card_name(line) != ".tran") continue;
+
+		std::istringstream tokens(line);
+		std::string tran, step_str, stop_str;
+		if (!(tokens >> tran >> step_str >> stop_str)) return 1;
+		step = parse_value(step_str);
+		stop = parse_value(stop_str);
+		uic = false;
+		std::string option;
+		while (tokens >> option) {
+			if (option == "uic" || option == "UIC") uic = true;
+		}
+		return 0;
+	}
+	return 1;
+}
+
+double Netlist::parse_value(const std::string &value)
+{
+	const char *start = value.c_str();
+	char *end;
+	double number = strtod(start, &end);
+
+	std::string suffix(end);
+	for (size_t i = 0; i < suffix.length(); i++)
+		suffix[i] = std::tolower(suffix[i]);
+	if (suffix.compare(0, 3, "meg") == 0) return number * 1e6;
+	if (suffix.compare(0, 3, "mil") == 0) return number * 25.4e-6;
+	if (suffix.empty()) return number;
+	switch (suffix[0]) {
+	case 't': return number * 1e12;
+	case 'g': return number * 1e9;
+	case 'k': return number * 1e3;
+	case 'm': return number * 1e-3;
+	case 'u': return number * 1e-6;
+	case 'n': return number * 1e-9;
+	case 'p': return number * 1e-12;
+	case 'f': return number * 1e-15;
+	default: return number;
+	}
+}
+
+void Netlist::find_nodes(std::set<std::string> &nodes, std::vector<std::string> &branches) const
+{
+	// The first line is the title
+	for (size_t i = 1; i < this->netlist_vec.size(); i++) {
+		std::istringstream line(this->netlist_vec[i]);
+		std::string name;
+		if (!(line >> name) || name[0] == '*' || name[0] == '.' || name[0] == '+')
+			continue;
+
+		for (size_t c = 0; c < name.length(); c++)
+			name[c] = std::tolower(name[c]);
+		char type = name[0];
+		size_t terminals = 2;
+		if (type == 'e' || type == 'g' || type == 'm') terminals = 4;
+		else if (type == 'q' || type == 'j') terminals = 3;
+		if (type == 'v' || type == 'l' || type == 'e' || type == 'h') branches.push_back(name);
+
+		std::string node;
+		for (size_t t = 0; t < terminals && line >> node; t++) {
+			if (node != "0" && node != "gnd") nodes.insert(node);
+		}
+	}
 }
 
 int Netlist::add_boundary_condition(
 	const std::string &element_name,
 	const std::string &file_given, 
-	const double &period_given
+	const double &period_given,
+	BoundaryConditionFiles* shared
 )
 {	
 
 	std::string file;
 	double period;
-	if (file_given == ""){
+	std::shared_ptr<const BoundaryCondition> cond;
+	if (file_given == "" && !this->interactive) {
+		std::cout << "Error: no boundary condition file given for " << element_name << std::endl;
+		return 1;
+	} else if (file_given == "" && shared && (cond = this->find_table(element_name, *shared, file))) {
+		std::cout << "Using column " << element_name << " of " << file << std::endl;
+	} else if (file_given == ""){
 		this->request_boundary_condition(element_name, file, period);
 	} else {
 		file = file_given;
 		period = period_given;
 	}
 
-	BoundaryCondition *cond = new BoundaryCondition(file, period);
-	char node_name_lower[element_name.length()];
+	if (!cond) {
+		cond = BoundaryConditionCache::instance().get(file, period, this->fourier_tolerance,
+			this->interpolation);
+		if (!cond->is_valid()) {
+			std::cout << "Error reading boundary condition file " << cond->get_error() << std::endl;
+			return 1;
+		}
+		if (shared) (*shared)[file] = cond;
+	}
+
+	size_t column = 0;
+	if (cond->get_columns() > 1) {
+		int found = cond->find_column(element_name);
+		if (found < 0) {
+			std::cout << "Error: " << file << " has no column named " << element_name << std::endl;
+			return 1;
+		}
+		column = found;
+	}
+
+	std::string node_name_lower(element_name);
 	for (size_t i = 0; i < element_name.length(); i++) {
 		node_name_lower[i] = std::tolower(element_name[i]);
 	}
-	this->bcs[node_name_lower] = cond;
+	if (this->source_index.find(node_name_lower) == this->source_index.end()) {
+		this->source_index[node_name_lower] = this->sources.size();
+		this->sources.push_back(BoundSource());
+	}
+	BoundSource &source = this->sources[this->source_index[node_name_lower]];
+	source.condition = cond;
+	source.column = column;
+	source.table.reset();
+	for (auto const& other : this->sources) {
+		if (other.condition == cond && other.table) source.table = other.table;
+	}
+	if (!source.table) {
+		source.table = std::make_shared<TableState>();
+		source.table->time = NAN;
+		source.table->states.resize(cond->get_columns());
+		source.table->current = source.table->states.data();
+		source.table->grid_scale = 0.0;
+		source.table->grid_points = 0;
+	}
 	return 0;
 }
 
+std::shared_ptr<const BoundaryCondition> Netlist::find_table(const std::string &element_name,
+	const BoundaryConditionFiles &shared, std::string &file) const
+{
+	for (auto const& val : shared) {
+		const BoundaryCondition &cond = *val.second;
+		if (cond.get_columns() > 1 && cond.find_column(element_name) >= 0
+			&& cond.get_fourier_tolerance() == this->fourier_tolerance
+			&& cond.get_requested_interpolation() == this->interpolation) {
+			file = val.first;
+			return val.second;
+		}
+	}
+	return NULL;
+}
+
 void Netlist::request_boundary_condition(
 	const std::string &node_name, 
 	std::string &file, 
 	double &period
 ) 
 {
-	std::cout << "Provide file containing boundary conditions for " << node_name << ": ";
+	std::cout << "Provide file containing boundary conditions for " << node_name
+		<< " (or a table with a column named " << node_name << "): ";
 	std::getline(std::cin, file);
 	std::cout << "Provide period for cardiac cycle: ";
 	std::string period_str;
@@ -101,10 +452,115 @@ void Netlist::request_boundary_condition(
 }
 
 
-double Netlist::get_boundary_condition(const std::string &node_name, double time)
+double Netlist::get_boundary_condition(const std::string &node_name, double time) const
+{
+	return this->get_source_state(this->source_index.at(node_name), time);
+}
+
+int Netlist::find_boundary_source(const char *node_name) const
+{
+	std::map<std::string, size_t>::const_iterator found = this->source_index.find(node_name);
+	return found == this->source_index.end() ? -1 : found->second;
+}
+
+std::vector<std::string> Netlist::get_external_elements() const
+{
+	std::vector<std::string> names;
+	for (auto const& val : this->source_index)
+		names.push_back(val.first);
+	return names;
+}
+
+double Netlist::get_source_state(int source_number, double time) const
+{
+	const BoundSource &source = this->sources[source_number];
+	TableState &table = *source.table;
+	if (time != table.time) {
+		table.time = time;
+		table.current = table.states.data();
+		if (table.samples) {
+			double x = time * table.grid_scale;
+			double k = std::nearbyint(x);
+			if (std::fabs(x - k) <= GRID_TOLERANCE && k >= 0) {
+				size_t point = static_cast<size_t>(k) % table.grid_points;
+				table.current = table.samples->data() + point * table.states.size();
+				return table.current[source.column];
+			}
+		}
+		source.condition->get_states(time, table.cursor, table.states.data());
+	}
+	return table.current[source.column];
+}
+
+int Netlist::resample_boundary_conditions(double step)
+{
+	int resampled = 0;
+	std::set<TableState*> done;
+	for (auto const& source : this->sources) {
+		TableState &table = *source.table;
+		if (!done.insert(&table).second) continue;
+		table.samples.reset();
+		table.time = NAN;
+		double period = source.condition->get_period();
+		if (step <= 0 || period <= 0) continue;
+		double points = std::round(period / step);
+		size_t columns = table.states.size();
+		if (points < 1 || std::fabs(points * step - period) > GRID_TOLERANCE * step
+			|| points * columns > MAX_RESAMPLED_STATES)
+			continue;
+
+		size_t n = static_cast<size_t>(points);
+		std::shared_ptr<std::vector<double> > samples = std::make_shared<std::vector<double> >(n * columns);
+		BoundaryCondition::Cursor cursor;
+		for (size_t k = 0; k < n; k++)
+			source.condition->get_states(k * step, cursor, &(*samples)[k * columns]);
+		table.samples = samples;
+		table.grid_scale = 1.0 / step;
+		table.grid_points = n;
+		resampled++;
+	}
+	return resampled;
+}
+
+double Netlist::next_boundary_knot(double time) const
+{
+	double next = HUGE_VAL;
+	for (auto const& source : this->sources) {
+		double knot = source.condition->next_knot(time);
+		if (knot < next) next = knot;
+	}
+	return next;
+}
+
+void Netlist::get_boundary_breakpoints(double start, double end, double threshold,
+	std::vector<double> &times) const
+{
+	size_t first = times.size();
+	for (auto const& source : this->sources) {
+		double period = source.condition->get_period();
+		if (period <= 0) continue;
+
+		std::vector<double> points;
+		source.condition->get_breakpoints(threshold, points, source.column);
+		if (points.empty()) continue;
+		for (double k = std::floor(start / period); k * period < end; k++) {
+			for (double t : points) {
+				double time = k * period + t;
+				if (time >= start && time < end)
+					times.push_back(time);
+			}
+		}
+	}
+	std::sort(times.begin() + first, times.end());
+	times.erase(std::unique(times.begin() + first, times.end()), times.end());
+}
+
+double Netlist::get_max_period() const
 {
- 	BoundaryCondition *bc = bcs[node_name];
- 	return bc->get_state(time);
+	double period = 0.0;
+	for (auto const& source : this->sources)
+		period = std::max(period, source.condition->get_period());
+	return period;
 }
 
 char** Netlist::get_netlist()
@@ -116,10 +572,8 @@ char** Netlist::get_netlist()
 
 int Netlist::construct_netlist()
 {	
-	if (this->netlist != NULL) {
-		std::cout << "Error: unload netlist before constructing a new one." << std::endl;
-		return 1;
-	}
+	// Lines may have changed since the last call
+	this->free_netlist();
 
 	this->netlist = new char*[this->netlist_vec.size() + 2];
 
@@ -134,26 +588,25 @@ int Netlist::construct_netlist()
 	return 0;
 }
 
-size_t Netlist::get_length()
-{
-	if (!this->constructed) return -1;
-	return this->netlist_vec.size() + 1;
-}
-
-void Netlist::unload_netlist()
+void Netlist::free_netlist()
 {
 	if(this->netlist != NULL) {
-		for (size_t i = 0; i < this->get_length(); i++)
-			delete this->netlist[i];
+		for (size_t i = 0; this->netlist[i] != NULL; i++)
+			free(this->netlist[i]);
 	}
 
-	delete this->netlist;
+	delete[] this->netlist;
 
 	this->netlist = NULL;
+	this->constructed = false;
+}
+
+void Netlist::unload_netlist()
+{
+	this->free_netlist();
 	this->netlist_vec.clear();
 
 	this->file_loaded = false;
-	this->constructed = false;
 }
 	
 
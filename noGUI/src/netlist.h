@@ -7,6 +7,8 @@ Class to represent a netlist.
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <memory>
 #include <iostream>
 
 #include "boundarycondition.h"
@@ -14,10 +16,19 @@ Class to represent a netlist.
 #ifndef __NETLIST_H__
 #define __NETLIST_H__
 
+/* Boundary conditions used by netlists, keyed by filename. Files are read through
+the BoundaryConditionCache, so each is parsed once whichever netlists use it; passing
+the same map to several Netlists also lets a table given at a prompt for one netlist
+be used for the elements of the others it has columns for. */
+typedef std::map<std::string, std::shared_ptr<const BoundaryCondition> > BoundaryConditionFiles;
+
 class Netlist
 {
 public:
 	Netlist(const std::string &name = "");
+	/* Copies share the boundary conditions of the original */
+	Netlist(const Netlist &other);
+	Netlist &operator=(const Netlist &other);
 	~Netlist();
 
 	/*
@@ -27,43 +38,225 @@ public:
 	char** get_netlist();
 	
 	/*
-	Get boundary condition at given node at the given time. Called by
-	ngspice callback.
+	Get boundary condition at given node at the given time, finding the node
+	by name. The ngspice callbacks resolve each name once instead (see
+	SourceHandles) and use get_source_state.
+	*/
+	double get_boundary_condition(const std::string &node_name, double time) const;
+
+	/*
+	Index of the boundary condition source of the element named node_name
+	(lowercase), or -1 if it has none. Indices stay valid until the netlist is
+	assigned to.
 	*/
-	double get_boundary_condition(const std::string &node_name, double time);
+	int find_boundary_source(const char *node_name) const;
+
+	/* Get the state of the boundary condition source with the given index */
+	double get_source_state(int source, double time) const;
+
+	/* Lowercase names of the elements with boundary conditions */
+	std::vector<std::string> get_external_elements() const;
+
+	/*
+	Get the first time after the given time at which any boundary condition
+	has a defined point. Returns HUGE_VAL if there are no boundary conditions.
+	*/
+	double next_boundary_knot(double time) const;
+
+	/*
+	Append to times, in increasing order, every time in [start, end) at which
+	the slope of a boundary condition changes by at least threshold (see
+	BoundaryCondition::get_breakpoints), repeated for every period.
+	*/
+	void get_boundary_breakpoints(double start, double end, double threshold,
+		std::vector<double> &times) const;
+
+	/* Longest period of the boundary conditions, or 0 if there are none */
+	double get_max_period() const;
+
+	/*
+	Store the states of each boundary condition at every multiple of step in
+	one period, so that a source asked for its state at one of them (as in a
+	run with a fixed time step, .tran <step> <stop> 0 <step>) reads it with a
+	single indexed load. Other times are still interpolated from the table.
+	Conditions whose period is not a whole number of steps, or would need more
+	than MAX_RESAMPLED_STATES states, are left as they are. A step of 0 drops
+	the stored states. Returns the number of tables resampled.
+	*/
+	int resample_boundary_conditions(double step);
+
+	static const size_t MAX_RESAMPLED_STATES = 1 << 24;
 
 	/*
 	Load a netlist from a file. Optionally pass a pointer to a dictionary
 	specifying external boundary condition files, and a period for these files.
+	A file given for the element "*" is used by every external element with no
+	file of its own. An element given a table with several value columns reads
+	the column named after it. Files are read through the BoundaryConditionCache.
+	If shared is given, the files used are added to it, and tables in it are
+	offered at the prompt.
 	*/
 	int load_from_file(
 		const std::string &filename,
 		const std::map<std::string, std::string>* bc_files = NULL,
-		const double period = 0.0
+		const double period = 0.0,
+		BoundaryConditionFiles* shared = NULL
 	);
 
+	/* Load a netlist from a string containing the whole netlist, as load_from_file */
+	int load_from_string(
+		const std::string &text,
+		const std::map<std::string, std::string>* bc_files = NULL,
+		const double period = 0.0,
+		BoundaryConditionFiles* shared = NULL
+	);
+
+	/*
+	Replace the analysis line (.tran, .dc, .ac or .op) with the given line, or
+	add it if the netlist has none.
+	*/
+	void set_analysis(const std::string &line);
+
+	/*
+	Add a .save line so that ngspice keeps only the given vectors (and the
+	time or sweep scale), instead of every node voltage and branch current.
+	Does nothing if vectors is empty.
+	*/
+	void add_save(const std::vector<std::string> &vectors);
+
+	/*
+	Estimate how many vectors ngspice keeps for this netlist without a .save
+	line: the scale, one voltage per node and one current per voltage source,
+	inductor and voltage-controlled element.
+	*/
+	size_t estimate_vector_count() const;
+
+	/*
+	Rough cost of running the netlist: the number of output points of the .tran
+	line times the estimated number of vectors. Returns 0 if there is no .tran line.
+	*/
+	double estimate_run_cost() const;
+
+	/*
+	Names of the vectors that hold the state of the circuit: the voltage
+	v(<node>) of every node, and the current <inductor>#branch of every inductor.
+	*/
+	std::vector<std::string> get_state_vectors() const;
+
+	/*
+	Replace any .ic lines with one giving the voltage of each node in
+	node_voltages, and set the ic= parameter of each inductor in
+	inductor_currents. Keys are node and element names.
+	*/
+	void set_initial_conditions(const std::map<std::string, double> &node_voltages,
+		const std::map<std::string, double> &inductor_currents);
+
+	/*
+	Replace the .options lines with the given line, or add it if there are none
+	*/
+	void set_options(const std::string &line);
+
+	/* Write the netlist, ending with .end. Returns 0 on success. */
+	int write_to_file(const std::string &filename) const;
+
+	/*
+	Return the value of every resistor, capacitor and inductor, keyed by element
+	name, as written in the netlist
+	*/
+	std::map<std::string, std::string> get_element_values() const;
+
+	/*
+	Read the step and stop time of the .tran line, and whether it has uic.
+	Returns 0 on success, or 1 if there is no .tran line.
+	*/
+	int get_transient(double &step, double &stop, bool &uic) const;
+
+	/* Parse a number with an optional SPICE scale factor, such as 10u or 1.5meg.
+	Any units following the scale factor are ignored. */
+	static double parse_value(const std::string &value);
+
+	/*
+	If interactive (the default), the user is asked for any boundary condition
+	files not given to load_from_file. Otherwise loading fails.
+	*/
+	void set_interactive(bool interactive) { this->interactive = interactive; }
+
+	/*
+	If above 0, boundary condition tables loaded afterwards are replaced by a
+	Fourier series within this fraction of the range of their values, when one
+	with at most half as many harmonics as points exists.
+	*/
+	void set_fourier_tolerance(double tolerance) { this->fourier_tolerance = tolerance; }
+
+	/* Interpolation of boundary condition tables loaded afterwards */
+	void set_interpolation(BoundaryCondition::Interpolation interpolation) { this->interpolation = interpolation; }
+
 private:
-	std::map<std::string, BoundaryCondition*> bcs;
+	/* Where this netlist last read a boundary condition, and the states of all
+	its value columns at that time. The condition may be shared, but each
+	netlist is run by one thread, so it keeps its own, shared by the elements
+	reading columns of the same table. ngspice asks for every element at the
+	same time, so the table is only interpolated once per time. */
+	struct TableState {
+		BoundaryCondition::Cursor cursor;
+		double time;
+		std::vector<double> states;
+		// The states at time: states, or a row of samples
+		const double *current;
+		// States of every column at the grid_points multiples of 1 / grid_scale
+		// in one period, one time after another, if resampled. They are never
+		// changed, so copies of the netlist share them.
+		std::shared_ptr<const std::vector<double> > samples;
+		double grid_scale;
+		size_t grid_points;
+	};
+	/* A boundary condition and the value column an element reads from it */
+	struct BoundSource {
+		std::shared_ptr<const BoundaryCondition> condition;
+		size_t column;
+		std::shared_ptr<TableState> table;
+	};
+	std::vector<BoundSource> sources;
+	std::map<std::string, size_t> source_index;
 	std::vector<std::string> netlist_vec;
 	char** netlist;
 	bool file_loaded;
 	bool constructed;
+	bool interactive;
+	double fourier_tolerance;
+	BoundaryCondition::Interpolation interpolation;
+
+	/* Read netlist lines from the stream. Called by load_from_file and load_from_string */
+	int load(
+		std::istream &f,
+		const std::map<std::string, std::string>* bc_files,
+		const double period,
+		BoundaryConditionFiles* shared
+	);
 
 	/* Add a boundary condition for the element given by element_name */
 	int add_boundary_condition(
 		const std::string &element_name, 
 		const std::string &file_given = "", 
-		const double &period_given = 0.0
+		const double &period_given = 0.0,
+		BoundaryConditionFiles* shared = NULL
 	);
+	/* Collect the nodes of all element lines, and the lowercase names of the
+	elements that add a branch current vector */
+	void find_nodes(std::set<std::string> &nodes, std::vector<std::string> &branches) const;
 	/* Free the memory associated with the netlist */
 	void unload_netlist();
-	/* Get the length of the netlist - used for freeing the char* array */
-	size_t get_length();
+	/* Free the char* array only, keeping the lines */
+	void free_netlist();
 	/* Construct the char* array */
 	int construct_netlist();
 	/* Request boundary condition info from user. Called if add_boundary_condition() is called without
 	a file and period */
 	void request_boundary_condition(const std::string &node_name, std::string &file, double &period);
+	/* Find a table already in shared with a column named element_name, loaded
+	with this netlist's settings. Returns NULL if there is none. */
+	std::shared_ptr<const BoundaryCondition> find_table(const std::string &element_name,
+		const BoundaryConditionFiles &shared, std::string &file) const;
 };
 
 
@@ -0,0 +1,78 @@
+/*
+outputstage.cc
+--------------
+Implement OutputStage class
+*/
+
+#include "outputstage.h"
+
+void OutputStage::reset(const OutputSampling &sampling, double stop)
+{
+	this->sampling = sampling;
+	this->start = (sampling.last > 0 && stop > sampling.last) ? stop - sampling.last : 0.0;
+	this->accepted = 0;
+	this->names.clear();
+	this->scale = 0;
+	this->columns.clear();
+	this->previous.clear();
+	// Grid times are start + i * step, counted rather than summed so that
+	// they do not drift over long runs
+	this->next_grid = 0;
+}
+
+void OutputStage::add_point(pvecvaluesall values)
+{
+	if (this->names.empty()) {
+		for (int i = 0; i < values->veccount; i++) {
+			this->names.push_back(values->vecsa[i]->name);
+			if (values->vecsa[i]->is_scale) this->scale = i;
+		}
+		this->columns.resize(this->names.size());
+	}
+	if ((size_t) values->veccount != this->names.size()) return;
+
+	// Only the real part of complex vectors is kept, as in SpiceInstance::get_results
+	std::vector<double> point(values->veccount);
+	for (int i = 0; i < values->veccount; i++)
+		point[i] = values->vecsa[i]->creal;
+	double time = point[this->scale];
+	this->accepted++;
+
+	if (this->sampling.step > 0) {
+		double grid = this->start + this->next_grid * this->sampling.step;
+		while (grid <= time) {
+			const std::vector<double> &before = this->previous.empty() ? point : this->previous;
+			double t0 = before[this->scale];
+			double w = (time > t0) ? (grid - t0) / (time - t0) : 1.0;
+			std::vector<double> interpolated(point.size());
+			for (size_t i = 0; i < point.size(); i++)
+				interpolated[i] = before[i] + w * (point[i] - before[i]);
+			interpolated[this->scale] = grid;
+			this->keep(interpolated);
+			this->next_grid++;
+			grid = this->start + this->next_grid * this->sampling.step;
+		}
+		this->previous.swap(point);
+		return;
+	}
+
+	if (time < this->start) return;
+	if (this->sampling.every > 1 && (this->accepted - 1) % this->sampling.every != 0) return;
+	this->keep(point);
+}
+
+void OutputStage::get_results(Results &results) const
+{
+	for (size_t i = 0; i < this->names.size(); i++) {
+		SimVector v;
+		v.name = this->names[i];
+		v.data = this->columns[i];
+		results.vectors.push_back(v);
+	}
+}
+
+void OutputStage::keep(const std::vector<double> &point)
+{
+	for (size_t i = 0; i < point.size(); i++)
+		this->columns[i].push_back(point[i]);
+}
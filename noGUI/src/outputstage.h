@@ -0,0 +1,74 @@
+/*
+OutputStage.h
+-------------
+Class to choose which simulated points are kept, as ngspice produces them.
+
+The time step of a transient run is chosen for accuracy, and is often much
+smaller than what is needed to look at the results. An OutputStage receives
+every accepted point from the ngspice SendData callback and keeps only
+
+- the points on a fixed output grid, linearly interpolated between the
+  accepted points around each grid time, or
+- every k-th accepted point,
+
+optionally only from a given time on, such as the last few cycles of a run.
+Points that are not kept are never stored, so the size of the results depends
+on what is kept, not on the internal time step.
+*/
+#include <string>
+#include <vector>
+
+#include "sharedspice.h"
+#include "results.h"
+
+#ifndef __OUTPUTSTAGE_H__
+#define __OUTPUTSTAGE_H__
+
+struct OutputSampling
+{
+	/* Spacing of the output grid, or 0 to keep accepted points */
+	double step;
+	/* Keep every k-th accepted point. Ignored if step is set. */
+	unsigned long every;
+	/* Keep only the last this many seconds of the run, or 0 for all of it */
+	double last;
+
+	OutputSampling() : step(0.0), every(1), last(0.0) {}
+	bool enabled() const { return this->step > 0 || this->every > 1 || this->last > 0; }
+};
+
+class OutputStage
+{
+public:
+	OutputStage() : start(0.0), accepted(0), scale(0), next_grid(0) {}
+
+	/* Start a new run ending at stop. Discards the points kept so far. */
+	void reset(const OutputSampling &sampling, double stop);
+
+	/* Called with each set of values sent by ngspice */
+	void add_point(pvecvaluesall values);
+
+	/* Copy the kept points into results, one vector per ngspice vector */
+	void get_results(Results &results) const;
+
+	/* Number of points kept, and accepted by ngspice, in the current run */
+	size_t get_kept() const { return this->columns.empty() ? 0 : this->columns[0].size(); }
+	unsigned long get_accepted() const { return this->accepted; }
+
+private:
+	OutputSampling sampling;
+	double start;
+	unsigned long accepted;
+
+	std::vector<std::string> names;
+	size_t scale;
+	std::vector<std::vector<double> > columns;
+
+	// Last accepted point, to interpolate grid points from
+	std::vector<double> previous;
+	unsigned long next_grid;
+
+	void keep(const std::vector<double> &point);
+};
+
+#endif
@@ -0,0 +1,60 @@
+/*
+progressmonitor.cc
+------------------
+Implement ProgressMonitor class
+*/
+
+#include <chrono>
+#include <stdio.h>
+
+#include "progressmonitor.h"
+
+ProgressMonitor::ProgressMonitor(const SpiceInstance *instance, double interval)
+{
+	this->instance = instance;
+	this->interval = interval;
+	this->stopping = false;
+}
+
+ProgressMonitor::~ProgressMonitor()
+{
+	this->stop();
+}
+
+void ProgressMonitor::start()
+{
+	if (this->thread.joinable()) return;
+	this->stopping = false;
+	this->thread = std::thread(&ProgressMonitor::sample, this);
+}
+
+void ProgressMonitor::stop()
+{
+	if (!this->thread.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->cond.notify_one();
+	this->thread.join();
+	this->print();
+	printf("\n");
+	fflush(stdout);
+}
+
+void ProgressMonitor::sample()
+{
+	std::chrono::duration<double> period(this->interval);
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (!this->cond.wait_for(lock, period, [this] { return this->stopping; }))
+		this->print();
+}
+
+/* Overwrite the status line in place */
+void ProgressMonitor::print()
+{
+	printf("\r%5.1f%%  t = %-12g %lu time steps, %lu rejected", this->instance->get_progress(),
+		this->instance->get_sim_time(), this->instance->get_steps(),
+		this->instance->get_rejected_steps());
+	fflush(stdout);
+}
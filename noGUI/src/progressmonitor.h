@@ -0,0 +1,45 @@
+/*
+ProgressMonitor.h
+-----------------
+Class to print the progress of a running simulation at a fixed rate.
+
+The ngspice callbacks of a SpiceInstance only store the percent done, the
+simulation time and the step counts in atomics. A ProgressMonitor samples
+these from a thread of its own every interval and prints one status line, so
+reporting progress costs the simulation thread nothing however often ngspice
+sends its status.
+*/
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "spiceinstance.h"
+
+#ifndef __PROGRESSMONITOR_H__
+#define __PROGRESSMONITOR_H__
+
+class ProgressMonitor
+{
+public:
+	/* Constructor: interval is the time between samples, in seconds */
+	ProgressMonitor(const SpiceInstance *instance, double interval);
+	~ProgressMonitor();
+
+	/* Start printing progress until stop() is called */
+	void start();
+	/* Stop printing, and finish the status line */
+	void stop();
+
+private:
+	const SpiceInstance *instance;
+	double interval;
+	bool stopping;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::thread thread;
+
+	void sample();
+	void print();
+};
+
+#endif
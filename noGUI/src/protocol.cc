@@ -0,0 +1,124 @@
+/*
+protocol.cc
+-----------
+Implement the lpnd job protocol
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "protocol.h"
+
+/* Strings longer than this are treated as a malformed message */
+static const uint32_t MAX_STRING = 64 * 1024 * 1024;
+
+static int write_uint(int fd, uint32_t value)
+{
+	return write_all(fd, &value, sizeof(value));
+}
+
+static int read_uint(int fd, uint32_t &value)
+{
+	return read_all(fd, &value, sizeof(value));
+}
+
+static int write_string(int fd, const std::string &s)
+{
+	if (write_uint(fd, s.length()) != 0) return 1;
+	return write_all(fd, s.data(), s.length());
+}
+
+static int read_string(int fd, std::string &s)
+{
+	uint32_t length;
+	if (read_uint(fd, length) != 0 || length > MAX_STRING) return 1;
+	s.resize(length);
+	return length == 0 ? 0 : read_all(fd, &s[0], length);
+}
+
+int write_request(int fd, const JobRequest &request)
+{
+	if (write_string(fd, request.netlist) != 0) return 1;
+
+	if (write_uint(fd, request.bc_files.size()) != 0) return 1;
+	for (auto const& bc : request.bc_files) {
+		if (write_string(fd, bc.first) != 0 || write_string(fd, bc.second) != 0)
+			return 1;
+	}
+
+	if (write_all(fd, &request.period, sizeof(request.period)) != 0) return 1;
+	if (write_string(fd, request.analysis) != 0) return 1;
+
+	if (write_uint(fd, request.vectors.size()) != 0) return 1;
+	for (const std::string &vec : request.vectors) {
+		if (write_string(fd, vec) != 0) return 1;
+	}
+	return 0;
+}
+
+int read_request(int fd, JobRequest &request)
+{
+	if (read_string(fd, request.netlist) != 0) return 1;
+
+	uint32_t count;
+	if (read_uint(fd, count) != 0) return 1;
+	for (uint32_t i = 0; i < count; i++) {
+		std::string element, file;
+		if (read_string(fd, element) != 0 || read_string(fd, file) != 0)
+			return 1;
+		request.bc_files[element] = file;
+	}
+
+	if (read_all(fd, &request.period, sizeof(request.period)) != 0) return 1;
+	if (read_string(fd, request.analysis) != 0) return 1;
+
+	if (read_uint(fd, count) != 0) return 1;
+	for (uint32_t i = 0; i < count; i++) {
+		std::string vec;
+		if (read_string(fd, vec) != 0) return 1;
+		request.vectors.push_back(vec);
+	}
+	return 0;
+}
+
+int write_response(int fd, const JobResponse &response)
+{
+	if (write_uint(fd, response.status) != 0) return 1;
+	if (write_string(fd, response.message) != 0) return 1;
+	if (response.status != 0) return 0;
+	return response.results.write_frames(fd);
+}
+
+int read_response(int fd, JobResponse &response)
+{
+	uint32_t status;
+	if (read_uint(fd, status) != 0) return 1;
+	response.status = status;
+	if (read_string(fd, response.message) != 0) return 1;
+	if (response.status != 0) return 0;
+	return response.results.read_frames(fd);
+}
+
+int submit_job(const std::string &socket_path, const JobRequest &request, JobResponse &response)
+{
+	struct sockaddr_un addr;
+	if (socket_path.length() >= sizeof(addr.sun_path)) return 1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return 1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		close(fd);
+		return 1;
+	}
+
+	int ret = write_request(fd, request);
+	if (ret == 0) ret = read_response(fd, response);
+	close(fd);
+	return ret;
+}
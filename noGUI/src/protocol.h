@@ -0,0 +1,64 @@
+/*
+Protocol.h
+----------
+Job protocol spoken over the Unix domain socket of the lpnd daemon.
+
+A client connects, sends one request and reads one response, then the
+connection is closed. Strings are sent as <uint32 length> <bytes>, and
+numbers in the byte order of the machine.
+
+Request:
+	<string netlist>                   full netlist text
+	<uint32 n> n x (<string element> <string file>)
+	                                   boundary condition files for external elements
+	<float64 period>                   period of the boundary condition files
+	<string analysis>                  replaces the analysis line of the netlist, if not empty
+	<uint32 m> m x <string vector>     vectors to return, or all if m is 0
+
+Response:
+	<uint32 status>                    0 on success
+	<string message>                   error message, if status is not 0
+	Results frames                     only if status is 0, see results.h
+*/
+#include <string>
+#include <vector>
+#include <map>
+
+#include "results.h"
+
+#ifndef __PROTOCOL_H__
+#define __PROTOCOL_H__
+
+#define LPND_DEFAULT_SOCKET "/tmp/lpnd.sock"
+
+struct JobRequest
+{
+	std::string netlist;
+	std::map<std::string, std::string> bc_files;
+	double period;
+	std::string analysis;
+	std::vector<std::string> vectors;
+
+	JobRequest() : period(0.0) {}
+};
+
+struct JobResponse
+{
+	unsigned int status;
+	std::string message;
+	Results results;
+
+	JobResponse() : status(0) {}
+};
+
+/* Each returns 0 on success, or 1 if the connection failed or the data was malformed */
+int write_request(int fd, const JobRequest &request);
+int read_request(int fd, JobRequest &request);
+int write_response(int fd, const JobResponse &response);
+int read_response(int fd, JobResponse &response);
+
+/* Connect to the daemon at socket_path, send the request and wait for the response.
+Returns 0 if a response was received; the job itself may still have failed. */
+int submit_job(const std::string &socket_path, const JobRequest &request, JobResponse &response);
+
+#endif
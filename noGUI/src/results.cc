@@ -0,0 +1,108 @@
+/*
+results.cc
+----------
+Implement Results class
+*/
+
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "results.h"
+
+static const uint32_t END_FRAME = 0xFFFFFFFF;
+
+int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = static_cast<const char*>(buf);
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return 1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int read_all(int fd, void *buf, size_t len)
+{
+	char *p = static_cast<char*>(buf);
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return 1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int Results::write_frames(int fd) const
+{
+	for (const SimVector &v : this->vectors) {
+		uint32_t name_len = v.name.length();
+		uint64_t length = v.data.size();
+		if (write_all(fd, &name_len, sizeof(name_len)) != 0 ||
+			write_all(fd, v.name.data(), name_len) != 0 ||
+			write_all(fd, &length, sizeof(length)) != 0 ||
+			write_all(fd, v.data.data(), length * sizeof(double)) != 0)
+			return 1;
+	}
+	return write_all(fd, &END_FRAME, sizeof(END_FRAME));
+}
+
+int Results::read_frames(int fd)
+{
+	while (true) {
+		uint32_t name_len;
+		if (read_all(fd, &name_len, sizeof(name_len)) != 0) return 1;
+		if (name_len == END_FRAME) return 0;
+
+		SimVector v;
+		v.name.resize(name_len);
+		uint64_t length;
+		if (read_all(fd, &v.name[0], name_len) != 0 ||
+			read_all(fd, &length, sizeof(length)) != 0)
+			return 1;
+		v.data.resize(length);
+		if (read_all(fd, v.data.data(), length * sizeof(double)) != 0)
+			return 1;
+		this->vectors.push_back(v);
+	}
+}
+
+void Results::write_table(std::ostream &out, bool header, size_t first_row) const
+{
+	size_t rows = 0;
+	for (const SimVector &v : this->vectors) {
+		if (header) out << v.name << "\t";
+		if (v.data.size() > rows) rows = v.data.size();
+	}
+	if (header) out << "\n";
+
+	out.precision(12);
+	for (size_t i = first_row; i < rows; i++) {
+		for (const SimVector &v : this->vectors) {
+			if (i < v.data.size()) out << v.data[i];
+			out << "\t";
+		}
+		out << "\n";
+	}
+}
+
+const SimVector *Results::find(const std::string &name) const
+{
+	for (const SimVector &v : this->vectors) {
+		if (v.name == name) return &v;
+	}
+	return NULL;
+}
+
+SimVector *Results::find(const std::string &name)
+{
+	for (SimVector &v : this->vectors) {
+		if (v.name == name) return &v;
+	}
+	return NULL;
+}
@@ -0,0 +1,52 @@
+/*
+Results.h
+---------
+Class to hold the vectors of a finished simulation outside of ngspice.
+
+Results can be sent between processes as binary frames over a pipe or
+socket: one frame per vector, followed by an end frame. Each frame is
+
+<uint32 name length> <name> <uint64 number of points> <float64 points...>
+
+and the end frame is a name length of 0xFFFFFFFF. Frames are written in the
+byte order of the machine, so both ends must run on the same machine.
+*/
+#include <string>
+#include <vector>
+#include <iostream>
+
+#ifndef __RESULTS_H__
+#define __RESULTS_H__
+
+struct SimVector
+{
+	std::string name;
+	std::vector<double> data;
+};
+
+class Results
+{
+public:
+	std::vector<SimVector> vectors;
+
+	/* Write all vectors as frames to the file descriptor. Returns 0 on success. */
+	int write_frames(int fd) const;
+	/* Read frames from the file descriptor until the end frame. Returns 0 on success,
+	or 1 if the stream ended early or was malformed. */
+	int read_frames(int fd);
+	/* Write the vectors as ASCII columns, with a header line of vector names
+	unless header is false, starting from row first_row */
+	void write_table(std::ostream &out, bool header = true, size_t first_row = 0) const;
+
+	/* Return the vector with the given name, or NULL */
+	const SimVector *find(const std::string &name) const;
+	SimVector *find(const std::string &name);
+	void clear() { this->vectors.clear(); }
+};
+
+/* Write or read exactly len bytes, retrying on short transfers as happen on
+pipes and sockets. Return 0 on success. */
+int write_all(int fd, const void *buf, size_t len);
+int read_all(int fd, void *buf, size_t len);
+
+#endif
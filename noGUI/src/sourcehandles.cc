@@ -0,0 +1,61 @@
+/*
+sourcehandles.cc
+----------------
+Implement the table of resolved external source names
+*/
+
+#include <string>
+#include <ctype.h>
+
+#include "sourcehandles.h"
+
+static const size_t INITIAL_SIZE = 16;
+
+SourceHandles::SourceHandles()
+{
+	this->netlist = NULL;
+	this->reset(NULL);
+}
+
+void SourceHandles::reset(const Netlist *netlist)
+{
+	this->netlist = netlist;
+	this->entries.assign(INITIAL_SIZE, Entry());
+	this->used = 0;
+}
+
+/* Look a name not seen before up in the netlist, and remember it. ngspice
+passes instance names in lowercase, but they are lowered here as well so as
+not to depend on it. */
+int SourceHandles::add(const char *name)
+{
+	int source = -1;
+	if (this->netlist) {
+		std::string lower(name);
+		for (size_t i = 0; i < lower.length(); i++)
+			lower[i] = tolower(static_cast<unsigned char>(lower[i]));
+		source = this->netlist->find_boundary_source(lower.c_str());
+	}
+
+	if (2 * (this->used + 1) > this->entries.size()) {
+		std::vector<Entry> old(2 * this->entries.size(), Entry());
+		old.swap(this->entries);
+		this->used = 0;
+		for (auto const& entry : old) {
+			if (entry.name) this->insert(entry.name, entry.source);
+		}
+	}
+	this->insert(name, source);
+	return source;
+}
+
+void SourceHandles::insert(const char *name, int source)
+{
+	size_t mask = this->entries.size() - 1;
+	size_t i = hash(name) & mask;
+	while (this->entries[i].name)
+		i = (i + 1) & mask;
+	this->entries[i].name = name;
+	this->entries[i].source = source;
+	this->used++;
+}
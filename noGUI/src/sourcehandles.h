@@ -0,0 +1,66 @@
+/*
+SourceHandles.h
+---------------
+Resolve the element names that ngspice passes to the external source
+callbacks into indices of the boundary condition sources of a Netlist.
+
+ngspice asks for the value of every external source at every iteration of
+every time step, passing the name of the source as a char* into its own
+copy of the circuit. That pointer stays the same for as long as the circuit
+is loaded, so each name is looked up in the Netlist once, the first time it
+is seen, and afterwards found by its pointer in a small open-addressing hash
+table, without building a string or comparing any characters.
+*/
+#include <vector>
+#include <stdint.h>
+
+#include "netlist.h"
+
+#ifndef __SOURCEHANDLES_H__
+#define __SOURCEHANDLES_H__
+
+class SourceHandles
+{
+public:
+	SourceHandles();
+
+	/* Forget every name, and resolve names against netlist from now on. Must
+	be called whenever ngspice loads a circuit, as the pointers it passes then
+	change and may be reused for other names. */
+	void reset(const Netlist *netlist);
+
+	/* Index of the netlist source for the name ngspice passed, or -1 if the
+	netlist has none */
+	int resolve(const char *name)
+	{
+		size_t mask = this->entries.size() - 1;
+		for (size_t i = hash(name) & mask; this->entries[i].name; i = (i + 1) & mask) {
+			if (this->entries[i].name == name) return this->entries[i].source;
+		}
+		return this->add(name);
+	}
+
+	/* Number of names resolved so far */
+	size_t size() const { return this->used; }
+
+private:
+	struct Entry {
+		const char *name;
+		int source;
+	};
+	// A power of two in size, and at most half full
+	std::vector<Entry> entries;
+	size_t used;
+	const Netlist *netlist;
+
+	static size_t hash(const char *name)
+	{
+		// Fibonacci hashing of the address; its low bits are always zero
+		uint64_t address = reinterpret_cast<uintptr_t>(name);
+		return static_cast<size_t>((address * 0x9E3779B97F4A7C15ULL) >> 32);
+	}
+	int add(const char *name);
+	void insert(const char *name, int source);
+};
+
+#endif
@@ -0,0 +1,684 @@
+/*
+spiceinstance.cc
+----------------
+Implement SpiceInstance class
+
+The callbacks are based on the example code provided by Ngspice,
+which can be dowloaded at this link:
+
+http://ngspice.sourceforge.net/ngspice-shared-lib/ngspice_cb.7z
+*/
+
+#include <iostream>
+#include <fstream>
+#include <dlfcn.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+
+#include "spiceinstance.h"
+
+/* How often a watched run checks its budgets */
+static const long WATCHDOG_TICK_NS = 20000000L;
+/* How long a watched run may take to stop after it is halted before the
+instance is abandoned */
+static const double HALT_GRACE_SECONDS = 10.0;
+/* A boundary condition point closer than this fraction of the proposed step
+is stepped over instead of ended on */
+static const double MIN_KNOT_STEP = 0.1;
+
+/* Live instances, indexed by the ident each one gave to ngSpice_Init_Sync */
+static SpiceInstance *instances[SpiceInstance::MAX_INSTANCES];
+
+static int ng_getchar(char* outputreturn, int ident, void* userdata);
+static int ng_getstat(char* outputreturn, int ident, void* userdata);
+static int ng_exit(int exitstatus, bool immediate, bool quitexit, int ident, void* userdata);
+static int ng_thread_runs(bool noruns, int ident, void* userdata);
+static int ng_initdata(pvecinfoall intdata, int ident, void* userdata);
+static int ng_data(pvecvaluesall vdata, int numvecs, int ident, void* userdata);
+static int ng_getexternal(double* value, double t, char* node, int ident, void* userdata);
+static int ng_getsync(double time, double* delta, double olddelta, int redostep, int ident,
+    int location, void* userdata);
+static int ciprefix(const char *p, const char *s);
+static int copy_library(const std::string &library, int ident, std::string &copy);
+
+SpiceInstance::SpiceInstance(int ident)
+{
+	this->ident = ident;
+	this->handle = NULL;
+	this->ngspice_command = NULL;
+	this->ngspice_circ = NULL;
+	this->ngspice_cur_plot = NULL;
+	this->ngspice_all_vecs = NULL;
+	this->ngspice_vec_info = NULL;
+	this->ngspice_set_bkpt = NULL;
+	this->netlist = NULL;
+	this->verbose = true;
+	this->errorflag = false;
+	this->steps = 0;
+	this->rejected_steps = 0;
+	this->progress = 0.0;
+	this->sim_time = 0.0;
+	this->time_offset = 0.0;
+	this->run_mode = RUN_AUTO;
+	this->foreground_cost = DEFAULT_FOREGROUND_COST;
+	this->cancel_token = NULL;
+	this->max_seconds = 0.0;
+	this->max_steps = 0;
+	this->stall_seconds = 0.0;
+	this->abort_reason = ABORT_NONE;
+	this->abandoned = false;
+	this->breakpoint_threshold = BoundaryCondition::DEFAULT_BREAKPOINT_THRESHOLD;
+	this->breakpoint_window = 0.0;
+	this->breakpoint_windows = 0;
+	this->no_bg = true;
+	this->bg_stops = 0;
+	pthread_mutex_init(&this->mutex, NULL);
+	pthread_cond_init(&this->cond, NULL);
+}
+
+/* The library is not unloaded: the ngspice background thread may still be
+returning from its last callback, and the copy is freed when the process exits. */
+SpiceInstance::~SpiceInstance()
+{
+	if (this->ident >= 0 && this->ident < MAX_INSTANCES && instances[this->ident] == this)
+		instances[this->ident] = NULL;
+
+	pthread_cond_destroy(&this->cond);
+	pthread_mutex_destroy(&this->mutex);
+}
+
+int SpiceInstance::init(const std::string &library)
+{
+	if (this->ident < 0 || this->ident >= MAX_INSTANCES || instances[this->ident]) {
+		std::cout << "Error: invalid ngspice instance number " << this->ident << std::endl;
+		return 1;
+	}
+
+	// Instance 0 uses the library as installed. Every other instance loads a private
+	// copy of it, so that each copy has its own set of ngspice globals.
+	std::string path = library;
+	if (this->ident > 0 && copy_library(library, this->ident, path) != 0)
+		return 1;
+	this->handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (path != library)
+		unlink(path.c_str()); // the mapping stays valid after the file is removed
+	if (!this->handle) {
+		std::cout << "Error: could not load " << library << ": " << dlerror() << std::endl;
+		return 1;
+	}
+
+	InitFunction init = (InitFunction) dlsym(this->handle, "ngSpice_Init");
+	InitSyncFunction init_sync = (InitSyncFunction) dlsym(this->handle, "ngSpice_Init_Sync");
+	this->ngspice_command = (CommandFunction) dlsym(this->handle, "ngSpice_Command");
+	this->ngspice_circ = (CircFunction) dlsym(this->handle, "ngSpice_Circ");
+	this->ngspice_cur_plot = (CurPlotFunction) dlsym(this->handle, "ngSpice_CurPlot");
+	this->ngspice_all_vecs = (AllVecsFunction) dlsym(this->handle, "ngSpice_AllVecs");
+	this->ngspice_vec_info = (VecInfoFunction) dlsym(this->handle, "ngGet_Vec_Info");
+	// Older libraries lack ngSpice_SetBkpt; they run without breakpoints
+	this->ngspice_set_bkpt = (SetBkptFunction) dlsym(this->handle, "ngSpice_SetBkpt");
+	if (!init || !init_sync || !this->ngspice_command || !this->ngspice_circ ||
+		!this->ngspice_cur_plot || !this->ngspice_all_vecs || !this->ngspice_vec_info) {
+		std::cout << "Error: could not load ngspice function" << std::endl;
+		return 1;
+	}
+
+	instances[this->ident] = this;
+	init(ng_getchar, ng_getstat, ng_exit, ng_data, ng_initdata, ng_thread_runs, this);
+	init_sync(ng_getexternal, ng_getexternal, ng_getsync, &this->ident, this);
+	return 0;
+}
+
+int SpiceInstance::load(Netlist *netlist)
+{
+	if (this->abandoned) return 1;
+	char **netlist_array = netlist->get_netlist();
+	if (netlist_array == NULL)
+		return 1;
+
+	this->netlist = netlist;
+	this->source_handles.reset(netlist);
+	this->errorflag = false;
+	int ret = this->ngspice_circ(netlist_array);
+	if (ret != 0) return ret;
+
+	this->start_run();
+	return 0;
+}
+
+int SpiceInstance::alter(const std::vector<ParameterChange> &changes)
+{
+	for (const ParameterChange &change : changes) {
+		std::string command = change.model ? "altermod " : "alter ";
+		command += change.name;
+		if (!change.parameter.empty())
+			command += " " + change.parameter;
+		command += " = " + change.value;
+		this->errorflag = false;
+		if (this->command(command) != 0 || this->errorflag) {
+			std::cout << "Error: could not apply " << command << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int SpiceInstance::rerun()
+{
+	if (!this->netlist) return 1;
+	this->command("destroy all");
+	this->errorflag = false;
+	this->start_run();
+	return this->run();
+}
+
+constexpr double SpiceInstance::DEFAULT_FOREGROUND_COST;
+
+const int SpiceInstance::ABORTED;
+
+int SpiceInstance::run()
+{
+	bool foreground = (this->run_mode == RUN_FOREGROUND);
+	if (this->is_watched()) {
+		foreground = false;
+	} else if (this->run_mode == RUN_AUTO && this->netlist) {
+		double cost = this->netlist->estimate_run_cost();
+		foreground = (cost > 0 && cost < this->foreground_cost);
+	}
+	return foreground ? this->run_foreground() : this->run_background();
+}
+
+int SpiceInstance::run_foreground()
+{
+	int ret = this->command("run");
+	if (ret != 0) return ret;
+	return this->errorflag ? 1 : 0;
+}
+
+int SpiceInstance::run_background()
+{
+	this->abort_reason = ABORT_NONE;
+	bool watched = this->is_watched();
+	auto start = std::chrono::steady_clock::now();
+	auto last_step = start;
+	auto halted = start;
+	bool halting = false;
+	unsigned long steps = 0;
+
+	pthread_mutex_lock(&this->mutex);
+	unsigned long stops = this->bg_stops;
+	int ret = this->command("bg_run");
+	if (ret != 0) {
+		pthread_mutex_unlock(&this->mutex);
+		return ret;
+	}
+
+	// Wait for background thread to exit. A short run can start and stop
+	// before this thread wakes up, so wait for the stop count to change
+	// rather than for no_bg to go false and then true again.
+	while(this->bg_stops == stops) {
+		if (!watched) {
+			pthread_cond_wait(&this->cond, &this->mutex);
+			continue;
+		}
+
+		// Watchdog: wake up every WATCHDOG_TICK to check the budgets
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += WATCHDOG_TICK_NS;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&this->cond, &this->mutex, &deadline);
+		if (this->bg_stops != stops) break;
+
+		auto now = std::chrono::steady_clock::now();
+		if (this->get_steps() != steps) {
+			steps = this->get_steps();
+			last_step = now;
+		}
+		if (this->cancel_token && this->cancel_token->is_cancelled())
+			this->request_abort(ABORT_CANCELLED);
+		if (this->max_seconds > 0 &&
+			std::chrono::duration<double>(now - start).count() > this->max_seconds)
+			this->request_abort(ABORT_TIME);
+		if (this->stall_seconds > 0 &&
+			std::chrono::duration<double>(now - last_step).count() > this->stall_seconds)
+			this->request_abort(ABORT_STALL);
+
+		// bg_halt waits for the background thread to exit, and the thread
+		// takes the mutex on its way out. If ngspice cannot stop it in time,
+		// the halt is tried again on the next tick.
+		if (this->abort_reason != ABORT_NONE) {
+			if (!halting) {
+				halting = true;
+				halted = now;
+			} else if (std::chrono::duration<double>(now - halted).count() > HALT_GRACE_SECONDS) {
+				this->abandoned = true;
+				break;
+			}
+			pthread_mutex_unlock(&this->mutex);
+			this->command("bg_halt");
+			pthread_mutex_lock(&this->mutex);
+		}
+	}
+	pthread_mutex_unlock(&this->mutex);
+
+	if (this->abandoned) {
+		printf("[%d] Could not halt ngspice, instance abandoned\n", this->ident);
+		return 1;
+	}
+
+	if (this->abort_reason != ABORT_NONE) {
+		printf("[%d] Run stopped at t = %g: %s\n", this->ident, this->get_sim_time(),
+			this->get_abort_reason().c_str());
+		return ABORTED;
+	}
+	return this->errorflag ? 1 : 0;
+}
+
+std::string SpiceInstance::get_abort_reason() const
+{
+	switch (this->abort_reason.load()) {
+	case ABORT_CANCELLED: return "cancelled";
+	case ABORT_TIME: return "wall time budget exceeded";
+	case ABORT_STEPS: return "time step budget exceeded";
+	case ABORT_STALL: return "no progress, ngspice stalled";
+	default: return "";
+	}
+}
+
+int SpiceInstance::get_results(Results &results)
+{
+	if (this->sampling.enabled()) {
+		this->output.get_results(results);
+		return 0;
+	}
+
+	char *plot = this->ngspice_cur_plot();
+	char **names = plot ? this->ngspice_all_vecs(plot) : NULL;
+	if (!names) return 1;
+
+	for (; *names; names++) {
+		std::string name = std::string(plot) + "." + *names;
+		pvector_info info = this->ngspice_vec_info(const_cast<char*>(name.c_str()));
+		if (!info) continue;
+
+		SimVector v;
+		v.name = *names;
+		v.data.resize(info->v_length);
+		for (int i = 0; i < info->v_length; i++) {
+			// Only the real part of complex vectors is kept
+			v.data[i] = info->v_realdata ? info->v_realdata[i] : info->v_compdata[i].cx_real;
+		}
+		results.vectors.push_back(v);
+	}
+	return 0;
+}
+
+size_t SpiceInstance::get_vector_length(const std::string &name)
+{
+	char *plot = this->ngspice_cur_plot();
+	if (!plot) return 0;
+	std::string full_name = std::string(plot) + "." + name;
+	pvector_info info = this->ngspice_vec_info(const_cast<char*>(full_name.c_str()));
+	return info ? info->v_length : 0;
+}
+
+size_t SpiceInstance::get_vector_count()
+{
+	char *plot = this->ngspice_cur_plot();
+	char **names = plot ? this->ngspice_all_vecs(plot) : NULL;
+	size_t count = 0;
+	for (; names && *names; names++)
+		count++;
+	return count;
+}
+
+void SpiceInstance::clear()
+{
+	this->command("destroy all");
+	this->command("remcirc");
+	this->netlist = NULL;
+	this->source_handles.reset(NULL);
+}
+
+int SpiceInstance::command(const std::string &command)
+{
+	if (!this->ngspice_command || this->abandoned) return 1;
+	return this->ngspice_command(const_cast<char*>(command.c_str()));
+}
+
+SpiceInstance *SpiceInstance::from_ident(int ident)
+{
+	if (ident < 0 || ident >= MAX_INSTANCES) return NULL;
+	return instances[ident];
+}
+
+int ParameterChange::parse(const std::string &spec, ParameterChange &change)
+{
+	std::string target = spec;
+	change.model = (target.compare(0, 6, "model:") == 0);
+	if (change.model) target = target.substr(6);
+
+	size_t eq = target.find('=');
+	if (eq == std::string::npos || eq == 0 || eq == target.length() - 1)
+		return 1;
+	change.value = target.substr(eq + 1);
+	target = target.substr(0, eq);
+
+	size_t dot = target.find('.');
+	if (dot == std::string::npos) {
+		change.name = target;
+		change.parameter = "";
+	} else {
+		change.name = target.substr(0, dot);
+		change.parameter = target.substr(dot + 1);
+	}
+	// Models have no value of their own
+	if (change.name.empty() || (change.model && change.parameter.empty()))
+		return 1;
+	return 0;
+}
+
+/* Output to stdout in ngspice is preceded by token stdout, same with stderr. */
+void SpiceInstance::_output(char *output)
+{
+	if (this->verbose)
+		printf("%s\n", output);
+	/* setting a flag if an error message occurred */
+	if (ciprefix("stderr Error:", output)) {
+		if (!this->verbose)
+			printf("[%d] %s\n", this->ident, output);
+		this->errorflag = true;
+	}
+}
+
+/* Status messages are of the form "tran 42.1%" while a simulation runs */
+void SpiceInstance::_status(char *status)
+{
+	if (this->verbose)
+		printf("%s\n", status);
+	const char *space = strchr(status, ' ');
+	if (space) {
+		double percent = strtod(space + 1, NULL);
+		if (percent > 0) this->progress.store(percent, std::memory_order_relaxed);
+	} else if (strcmp(status, "--ready--") == 0) {
+		this->progress.store(100.0, std::memory_order_relaxed);
+	}
+}
+
+void SpiceInstance::_thread_runs(bool noruns)
+{
+	pthread_mutex_lock(&this->mutex);
+	this->no_bg = noruns;
+	if (noruns) this->bg_stops++;
+	pthread_cond_signal(&this->cond);
+	pthread_mutex_unlock(&this->mutex);
+	if (this->verbose)
+		printf(noruns ? "bg not running\n" : "bg running\n");
+}
+
+void SpiceInstance::_data(pvecvaluesall values)
+{
+	if (this->sampling.enabled())
+		this->output.add_point(values);
+}
+
+void SpiceInstance::_init_data(pvecinfoall intdata)
+{
+	for (int i = 0; i < intdata->veccount; i++) {
+		if (this->verbose)
+			printf("Vector: %s\n", intdata->vecs[i]->vecname);
+		this->vecnames.insert(intdata->vecs[i]->vecname);
+	}
+}
+
+/* Unloading ngspice from within its own thread is not possible, so the instance
+is marked as failed and the caller decides what to do. */
+void SpiceInstance::_controlled_exit(int exitstatus, bool immediate, bool quitexit)
+{
+	if (quitexit) {
+		if (this->verbose)
+			printf("DNote: Returned from quit with exit status %d\n", exitstatus);
+		return;
+	}
+	if (immediate) {
+		printf("[%d] DNote: Unloading ngspice immediately is not possible\n", this->ident);
+	} else {
+		printf("[%d] DNote: Unloading ngspice is not possible\n", this->ident);
+	}
+	this->errorflag = true;
+}
+
+/* The node name is resolved to a source of the netlist the first time it is
+seen, and found by its address afterwards (see SourceHandles) */
+void SpiceInstance::_get_external(double *value, double t, char *node)
+{
+	int source = this->source_handles.resolve(node);
+	if (source < 0) {
+		if (!this->errorflag)
+			printf("[%d] Error: no boundary condition for %s\n", this->ident, node);
+		this->errorflag = true;
+		*value = 0.0;
+		return;
+	}
+	*value = this->netlist->get_source_state(source, t + this->time_offset);
+}
+
+/* Called before ngspice tries a new time step (location 0) and after it has
+decided whether to redo the last one (location 1). The proposed step is
+shortened so that it ends on the next point defined in a boundary condition
+file: the interpolated input has a kink at each of these points, and a step
+across one is likely to be rejected. A point only a sliver ahead is stepped
+over, as ending on it would make ngspice take a tiny step and then several
+more to grow back; the step ends on the next point within it instead, or
+runs on whole. */
+void SpiceInstance::_sync(double time, double *delta, int redostep, int location)
+{
+	// Only this thread writes the counters, so plain loads and stores will do
+	if (redostep)
+		this->rejected_steps.store(this->get_rejected_steps() + 1, std::memory_order_relaxed);
+	if (location != 0) return;
+
+	this->steps.store(this->get_steps() + 1, std::memory_order_relaxed);
+	this->sim_time.store(time + this->time_offset, std::memory_order_relaxed);
+	if (this->max_steps > 0 && this->get_steps() > this->max_steps)
+		this->request_abort(ABORT_STEPS);
+	else if (this->cancel_token && this->cancel_token->is_cancelled())
+		this->request_abort(ABORT_CANCELLED);
+	if (!this->netlist) return;
+	if (time + this->breakpoint_window >= this->breakpoint_windows * this->breakpoint_window)
+		this->add_breakpoint_window();
+	double end = time + *delta;
+	double knot = this->netlist->next_boundary_knot(time + this->time_offset) - this->time_offset;
+	while (knot < end && knot - time < MIN_KNOT_STEP * *delta)
+		knot = this->netlist->next_boundary_knot(knot + this->time_offset) - this->time_offset;
+	if (end > knot)
+		*delta = knot - time;
+}
+
+bool SpiceInstance::is_watched() const
+{
+	return this->cancel_token || this->max_seconds > 0 || this->max_steps > 0 ||
+		this->stall_seconds > 0;
+}
+
+/* Keep the first reason given */
+void SpiceInstance::request_abort(AbortReason reason)
+{
+	int none = ABORT_NONE;
+	this->abort_reason.compare_exchange_strong(none, reason);
+}
+
+/* Breakpoints set before the run starts are kept by ngspice until the
+transient analysis begins. The rest are added by _sync as time goes on. */
+void SpiceInstance::start_run()
+{
+	this->steps = 0;
+	this->rejected_steps = 0;
+	this->progress = 0.0;
+	this->sim_time = this->time_offset;
+	this->vecnames.clear();
+	if (this->sampling.enabled()) {
+		double step, stop;
+		bool uic;
+		if (this->netlist->get_transient(step, stop, uic) != 0) stop = 0.0;
+		this->output.reset(this->sampling, stop);
+	}
+	this->breakpoint_window = this->netlist->get_max_period();
+	this->breakpoint_windows = 0;
+	this->add_breakpoint_window();
+	this->add_breakpoint_window();
+}
+
+/* Register the boundary condition breakpoints of the next window */
+void SpiceInstance::add_breakpoint_window()
+{
+	if (!this->ngspice_set_bkpt || !this->netlist || this->breakpoint_window <= 0)
+		return;
+
+	std::vector<double> times;
+	double start = this->time_offset + this->breakpoint_windows * this->breakpoint_window;
+	this->breakpoint_windows++;
+	double end = this->time_offset + this->breakpoint_windows * this->breakpoint_window;
+	this->netlist->get_boundary_breakpoints(start, end, this->breakpoint_threshold, times);
+	for (double t : times)
+		this->ngspice_set_bkpt(t - this->time_offset);
+}
+
+/********************************************************************************
+NGSPICE CALLBACK FUNCTIONS
+
+The following functions are used as callbacks for the Ngspice background thread
+to communicate with the main thread of execution. Every copy of the library calls
+the same functions, with the ident the instance was initialized with.
+
+Chapter 19 of the manual contains more information about these callbacks.
+*********************************************************************************/
+
+/* Transfer any string created by printf or puts. */
+static int
+ng_getchar(char* outputreturn, int ident, void* userdata)
+{
+    SpiceInstance *instance = SpiceInstance::from_ident(ident);
+    if (instance) instance->_output(outputreturn);
+    return 0;
+}
+
+/* Transfer status messages */
+static int
+ng_getstat(char* outputreturn, int ident, void* userdata)
+{
+    SpiceInstance *instance = SpiceInstance::from_ident(ident);
+    if (instance) instance->_status(outputreturn);
+    return 0;
+}
+
+/* Called when the bg thread starts/stops running */
+static int
+ng_thread_runs(bool noruns, int ident, void* userdata)
+{
+    SpiceInstance *instance = SpiceInstance::from_ident(ident);
+    if (instance) instance->_thread_runs(noruns);
+    return 0;
+}
+
+/* Called from bg thread in ngspice once upon intialization
+   of the simulation vectors */
+static int
+ng_initdata(pvecinfoall intdata, int ident, void* userdata)
+{
+    SpiceInstance *instance = SpiceInstance::from_ident(ident);
+    if (instance) instance->_init_data(intdata);
+    return 0;
+}
+
+/* Callback function called from bg thread in ngspice if fcn controlled_exit()
+   is hit. */
+static int
+ng_exit(int exitstatus, bool immediate, bool quitexit, int ident, void* userdata)
+{
+    SpiceInstance *instance = SpiceInstance::from_ident(ident);
+    if (instance) instance->_controlled_exit(exitstatus, immediate, quitexit);
+    return exitstatus;
+}
+
+/* Called from bg thread with the values of every vector at each accepted point */
+static int
+ng_data(pvecvaluesall vdata, int numvecs, int ident, void* userdata)
+{
+    SpiceInstance *instance = SpiceInstance::from_ident(ident);
+    if (instance) instance->_data(vdata);
+    return 0;
+}
+
+/* Called when the simulation needs a value from an external element */
+static int
+ng_getexternal(double* value, double t, char* node, int ident, void* userdata)
+{
+    SpiceInstance *instance = SpiceInstance::from_ident(ident);
+    if (instance) instance->_get_external(value, t, node);
+    return 0;
+}
+
+/* Copy the shared library to a temporary file, and set copy to its path.
+The installed library is found by loading it once and asking the dynamic
+linker where it came from. */
+static int
+copy_library(const std::string &library, int ident, std::string &copy)
+{
+    void *probe = dlopen(library.c_str(), RTLD_LAZY | RTLD_LOCAL);
+    struct link_map *map = NULL;
+    if (!probe || dlinfo(probe, RTLD_DI_LINKMAP, &map) != 0) {
+        std::cout << "Error: could not load " << library << ": " << dlerror() << std::endl;
+        if (probe) dlclose(probe);
+        return 1;
+    }
+    std::ifstream in(map->l_name, std::ios::binary);
+    dlclose(probe);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/tmp/lpn-ngspice-%d-XXXXXX", ident);
+    int fd = mkstemp(name);
+    if (fd < 0 || !in) {
+        std::cout << "Error: could not copy " << library << " for instance " << ident << std::endl;
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    close(fd);
+    std::ofstream out(name, std::ios::binary);
+    out << in.rdbuf();
+    copy = name;
+    return out ? 0 : 1;
+}
+
+/* Called by ngspice to synchronize its time step with the caller */
+static int
+ng_getsync(double time, double* delta, double olddelta, int redostep, int ident,
+    int location, void* userdata)
+{
+    SpiceInstance *instance = SpiceInstance::from_ident(ident);
+    if (instance) instance->_sync(time, delta, redostep, location);
+    return 0;
+}
+
+/* Case insensitive prefix. */
+static int
+ciprefix(const char *p, const char *s)
+{
+    while (*p) {
+        if ((isupper(*p) ? tolower(*p) : *p) !=
+            (isupper(*s) ? tolower(*s) : *s))
+            return(false);
+        p++;
+        s++;
+    }
+    return (true);
+}
@@ -0,0 +1,253 @@
+/*
+SpiceInstance.h
+---------------
+Class to represent one independent copy of the ngspice shared library.
+
+Ngspice keeps its circuit and simulation state in global variables, so one
+library can only run one circuit at a time. Each SpiceInstance opens a private
+copy of the library (a copy of libngspice.so opened with RTLD_LOCAL), which gets
+its own set of globals. Callbacks from every copy are routed back to the right
+SpiceInstance by the ident number given to ngSpice_Init_Sync.
+*/
+#include <string>
+#include <set>
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+
+#include "sharedspice.h"
+#include "netlist.h"
+#include "sourcehandles.h"
+#include "results.h"
+#include "outputstage.h"
+
+#ifndef __SPICEINSTANCE_H__
+#define __SPICEINSTANCE_H__
+
+/* A new value for an element, or for a parameter of an element or model */
+struct ParameterChange
+{
+	std::string name;
+	/* Empty to change the value of an element, such as the resistance of a resistor */
+	std::string parameter;
+	std::string value;
+	/* Change a model parameter with altermod instead of alter */
+	bool model;
+
+	ParameterChange() : model(false) {}
+
+	/* Parse <element>=<value>, <element>.<parameter>=<value> or
+	model:<model>.<parameter>=<value>. Returns 0 on success. */
+	static int parse(const std::string &spec, ParameterChange &change);
+};
+
+/* Flag to stop runs early. One token may be shared by many instances, and
+cancelled from any thread or from a signal handler. */
+struct CancelToken
+{
+	std::atomic<bool> cancelled;
+
+	CancelToken() : cancelled(false) {}
+	void cancel() { this->cancelled.store(true); }
+	bool is_cancelled() const { return this->cancelled.load(); }
+};
+
+class SpiceInstance
+{
+public:
+	/* Size of the table used to route callbacks by ident */
+	static const int MAX_INSTANCES = 64;
+
+	/* Constructor: ident must be unique among live instances and less than MAX_INSTANCES */
+	SpiceInstance(int ident);
+	~SpiceInstance();
+
+	/* Open a private copy of the library and initialize ngspice. Returns 0 on success. */
+	int init(const std::string &library = "libngspice.so");
+
+	/* Load the netlist into ngspice. The netlist is used to answer requests for external
+	boundary conditions, so it must stay alive until the run is finished. */
+	int load(Netlist *netlist);
+
+	/* How run() executes a circuit: with run on the calling thread, with bg_run in the
+	ngspice background thread, or chosen by the estimated cost of the circuit */
+	enum RunMode { RUN_AUTO, RUN_FOREGROUND, RUN_BACKGROUND };
+
+	/* In RUN_AUTO mode, circuits with an estimated cost (see Netlist::estimate_run_cost)
+	below this are run in the foreground */
+	static constexpr double DEFAULT_FOREGROUND_COST = 1e5;
+
+	/* Returned by the run functions when a run was halted early by its cancel token or
+	one of its budgets. The results of the run so far are kept. */
+	static const int ABORTED = 2;
+
+	/* Run the loaded circuit and block until it finishes. Returns 0 on success, or
+	ABORTED. */
+	int run();
+
+	/* Run the loaded circuit with run, on the calling thread. Nothing waits on the
+	background thread, so this is faster for short runs. Returns 0 on success. */
+	int run_foreground();
+
+	/* Run the loaded circuit in the ngspice background thread and block until it
+	finishes. While it waits, the calling thread acts as a watchdog: it halts the run
+	with bg_halt once the cancel token or a budget says so. Returns 0 on success,
+	or ABORTED. */
+	int run_background();
+
+	/* Limits on each run, 0 for none: wall clock time, time steps, and the time
+	without a new step after which ngspice is taken to have stalled. Runs with a
+	limit or a cancel token are always run in the background, so they can be halted. */
+	void set_time_budget(double seconds) { this->max_seconds = seconds; }
+	void set_step_budget(unsigned long steps) { this->max_steps = steps; }
+	void set_stall_timeout(double seconds) { this->stall_seconds = seconds; }
+	/* Checked by the callbacks and the watchdog; may be NULL */
+	void set_cancel_token(const CancelToken *token) { this->cancel_token = token; }
+
+	/* Why the last run was halted, or an empty string if it finished */
+	std::string get_abort_reason() const;
+
+	/* True once a run could not be halted after its grace period. The
+	instance then refuses every command, and cannot run any more jobs. */
+	bool is_abandoned() const { return this->abandoned; }
+
+	/* Change element values or parameters of the loaded circuit in place with alter and
+	altermod, without parsing it again. Takes effect on the next run. Returns 0 on success. */
+	int alter(const std::vector<ParameterChange> &changes);
+
+	/* Run the loaded circuit again from the start, as run(), after freeing the plots of
+	earlier runs. Returns 0 on success. */
+	int rerun();
+
+	/* Copy the vectors of the current plot into results, or only the points kept by
+	the output sampling if it is enabled. Returns 0 on success. */
+	int get_results(Results &results);
+
+	/* Keep only some of the points of each run as they are produced (see OutputStage),
+	for get_results to return */
+	void set_output_sampling(const OutputSampling &sampling) { this->sampling = sampling; }
+	bool is_sampling() const { return this->sampling.enabled(); }
+
+	/* Number of points in the named vector of the current plot, or 0 if there is none */
+	size_t get_vector_length(const std::string &name);
+	/* Number of vectors in the current plot */
+	size_t get_vector_count();
+
+	/* Free all plots and circuits so the instance can be used for the next job */
+	void clear();
+
+	/* Send a regular ngspice command. Returns 0 on success. */
+	int command(const std::string &command);
+
+	/* Boundary condition points where the slope changes by at least threshold are
+	given to ngspice as breakpoints (see BoundaryCondition::get_breakpoints) */
+	void set_breakpoint_threshold(double threshold) { this->breakpoint_threshold = threshold; }
+
+	/* Simulation time 0 is taken as this time when looking up boundary conditions,
+	so that a run can continue where an earlier one stopped */
+	void set_time_offset(double offset) { this->time_offset = offset; }
+
+	/* See RunMode. A foreground cost of 0 runs every circuit in the background. */
+	void set_run_mode(RunMode mode) { this->run_mode = mode; }
+	void set_foreground_cost(double cost) { this->foreground_cost = cost; }
+
+	/* Print ngspice output and status messages to stdout */
+	void set_verbose(bool verbose) { this->verbose = verbose; }
+
+	/* Time steps tried in the last simulation, and how many of them ngspice rejected */
+	unsigned long get_steps() const { return this->steps.load(std::memory_order_relaxed); }
+	unsigned long get_rejected_steps() const { return this->rejected_steps.load(std::memory_order_relaxed); }
+
+	/* Percent done and simulation time of the current simulation. Like the step
+	counts, these are only stored by the callbacks, and may be sampled from any
+	thread while the simulation runs. */
+	double get_progress() const { return this->progress.load(std::memory_order_relaxed); }
+	double get_sim_time() const { return this->sim_time.load(std::memory_order_relaxed); }
+
+	/* Names of the vectors in the last simulation */
+	const std::set<std::string> &get_vector_names() const { return this->vecnames; }
+	bool get_error() const { return this->errorflag; }
+	int get_ident() const { return this->ident; }
+
+	/* Find the instance with the given ident. Used by the ngspice callbacks. */
+	static SpiceInstance *from_ident(int ident);
+
+	/* Used by the ngspice callbacks only */
+	void _output(char *output);
+	void _status(char *status);
+	void _thread_runs(bool noruns);
+	void _init_data(pvecinfoall intdata);
+	void _data(pvecvaluesall values);
+	void _controlled_exit(int exitstatus, bool immediate, bool quitexit);
+	void _get_external(double *value, double t, char *node);
+	void _sync(double time, double *delta, int redostep, int location);
+
+private:
+	typedef int (*InitFunction)(SendChar*, SendStat*, ControlledExit*, SendData*, SendInitData*,
+		BGThreadRunning*, void*);
+	typedef int (*InitSyncFunction)(GetVSRCData*, GetISRCData*, GetSyncData*, int*, void*);
+	typedef int (*CommandFunction)(char*);
+	typedef int (*CircFunction)(char**);
+	typedef char* (*CurPlotFunction)(void);
+	typedef char** (*AllVecsFunction)(char*);
+	typedef pvector_info (*VecInfoFunction)(char*);
+	typedef bool (*SetBkptFunction)(double);
+
+	int ident;
+	void *handle;
+	CommandFunction ngspice_command;
+	CircFunction ngspice_circ;
+	CurPlotFunction ngspice_cur_plot;
+	AllVecsFunction ngspice_all_vecs;
+	VecInfoFunction ngspice_vec_info;
+	SetBkptFunction ngspice_set_bkpt;
+
+	Netlist *netlist;
+	// The external sources of the loaded circuit, by the names ngspice passes
+	SourceHandles source_handles;
+	std::set<std::string> vecnames;
+	bool verbose;
+	bool errorflag;
+	// Progress counters, written only by the thread running the simulation
+	std::atomic<unsigned long> steps;
+	std::atomic<unsigned long> rejected_steps;
+	std::atomic<double> progress;
+	std::atomic<double> sim_time;
+	double time_offset;
+	RunMode run_mode;
+	double foreground_cost;
+	OutputSampling sampling;
+	OutputStage output;
+
+	// Budgets and cancellation. abort_reason is set by the callbacks or the
+	// watchdog, whichever notices first.
+	enum AbortReason { ABORT_NONE, ABORT_CANCELLED, ABORT_TIME, ABORT_STEPS, ABORT_STALL };
+	const CancelToken *cancel_token;
+	double max_seconds;
+	unsigned long max_steps;
+	double stall_seconds;
+	std::atomic<int> abort_reason;
+	// Set if a run could not be halted; its thread may still be using the library
+	bool abandoned;
+	bool is_watched() const;
+	void request_abort(AbortReason reason);
+
+	// Breakpoints are registered at least one window (the longest boundary
+	// condition period) ahead of the simulation time. The first
+	// breakpoint_windows windows are registered so far.
+	double breakpoint_threshold;
+	double breakpoint_window;
+	unsigned long breakpoint_windows;
+	void add_breakpoint_window();
+	/* Reset the step counts and breakpoints for a new run of the loaded circuit */
+	void start_run();
+
+	// The mutex and condition variable protect no_bg and bg_stops, which are set
+	// by the background thread when it starts and stops running.
+	bool no_bg;
+	unsigned long bg_stops;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+#endif
@@ -0,0 +1,153 @@
+/*
+spicepool.cc
+------------
+Implement SpicePool class
+*/
+
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+#include "spicepool.h"
+
+SpicePool::SpicePool(size_t size)
+{
+	if (size < 1) size = 1;
+	if (size > SpiceInstance::MAX_INSTANCES) {
+		std::cout << "Warning: at most " << SpiceInstance::MAX_INSTANCES
+			<< " ngspice instances can be loaded. Using " << SpiceInstance::MAX_INSTANCES
+			<< "." << std::endl;
+		size = SpiceInstance::MAX_INSTANCES;
+	}
+
+	for (size_t i = 0; i < size; i++)
+		this->instances.push_back(new SpiceInstance(i));
+}
+
+SpicePool::~SpicePool()
+{
+	for (SpiceInstance *instance : this->instances)
+		delete instance;
+}
+
+int SpicePool::init(const std::string &library)
+{
+	for (SpiceInstance *instance : this->instances) {
+		instance->set_verbose(false);
+		if (instance->init(library) != 0)
+			return 1;
+	}
+	return 0;
+}
+
+void SpicePool::set_breakpoint_threshold(double threshold)
+{
+	for (SpiceInstance *instance : this->instances)
+		instance->set_breakpoint_threshold(threshold);
+}
+
+void SpicePool::set_foreground_cost(double cost)
+{
+	for (SpiceInstance *instance : this->instances)
+		instance->set_foreground_cost(cost);
+}
+
+void SpicePool::set_output_sampling(const OutputSampling &sampling)
+{
+	for (SpiceInstance *instance : this->instances)
+		instance->set_output_sampling(sampling);
+}
+
+void SpicePool::set_budgets(double seconds, unsigned long steps, double stall,
+	const CancelToken *token)
+{
+	for (SpiceInstance *instance : this->instances) {
+		instance->set_time_budget(seconds);
+		instance->set_step_budget(steps);
+		instance->set_stall_timeout(stall);
+		instance->set_cancel_token(token);
+	}
+}
+
+int SpicePool::run(std::vector<SpiceJob> &jobs)
+{
+	std::mutex queue_mutex;
+	size_t next_job = 0;
+	int failed = 0;
+	size_t live = this->instances.size();
+
+	// Each worker owns one instance, and takes the next job from the queue
+	// as soon as its instance is idle. A worker whose instance is abandoned
+	// stops, leaving the queue to the others; if none are left, the jobs
+	// still queued are not run.
+	auto worker = [&](SpiceInstance *instance) {
+		while (true) {
+			if (instance->is_abandoned()) {
+				std::lock_guard<std::mutex> lock(queue_mutex);
+				if (--live > 0) return;
+				for (; next_job < jobs.size(); next_job++) {
+					jobs[next_job].status = 1;
+					failed++;
+					std::cout << "Job " << jobs[next_job].output_file
+						<< " not run: every ngspice instance was abandoned." << std::endl;
+				}
+				return;
+			}
+
+			SpiceJob *job;
+			{
+				std::lock_guard<std::mutex> lock(queue_mutex);
+				if (next_job == jobs.size()) return;
+				job = &jobs[next_job++];
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			job->status = instance->load(job->netlist);
+			if (job->status == 0)
+				job->status = instance->run();
+			job->seconds = std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - start).count();
+			// A job stopped early keeps the results it has so far
+			bool aborted = (job->status == SpiceInstance::ABORTED);
+			if (aborted) job->status = 0;
+			if (job->status == 0 && job->results) {
+				job->status = instance->get_results(*job->results);
+			} else if (job->status == 0 && instance->is_sampling()) {
+				// ngspice holds every point, so the kept ones are written here
+				Results results;
+				job->status = instance->get_results(results);
+				std::ofstream out(job->output_file);
+				results.write_table(out);
+				if (job->status == 0 && !out) job->status = 1;
+			} else if (job->status == 0) {
+				job->status = instance->command("set filetype=ascii");
+				if (job->status == 0)
+					job->status = instance->command("write " + job->output_file);
+			}
+			if (aborted && job->status == 0) job->status = SpiceInstance::ABORTED;
+			instance->clear();
+
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			if (job->status == SpiceInstance::ABORTED) {
+				failed++;
+				std::cout << "Job " << job->output_file << " stopped early: "
+					<< instance->get_abort_reason() << "." << std::endl;
+			} else if (job->status != 0) {
+				failed++;
+				std::cout << "Job " << job->output_file << " failed." << std::endl;
+			} else if (!job->results) {
+				std::cout << "Job " << job->output_file << " finished." << std::endl;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (SpiceInstance *instance : this->instances)
+		workers.push_back(std::thread(worker, instance));
+	for (std::thread &t : workers)
+		t.join();
+
+	return failed;
+}
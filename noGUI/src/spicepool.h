@@ -0,0 +1,69 @@
+/*
+SpicePool.h
+-----------
+Class to run many circuits on a fixed number of SpiceInstances.
+
+Each instance runs on a worker thread of its own. Workers take the next
+unstarted job whenever they become idle, so long and short jobs balance out
+across the pool. Jobs may share BoundaryCondition objects, since these are
+only read during a simulation.
+*/
+#include <string>
+#include <vector>
+
+#include "spiceinstance.h"
+#include "netlist.h"
+#include "results.h"
+
+#ifndef __SPICEPOOL_H__
+#define __SPICEPOOL_H__
+
+struct SpiceJob
+{
+	Netlist *netlist;
+	/* File to write all vectors to, in ASCII format */
+	std::string output_file;
+	/* If not NULL, the vectors are copied here instead of being written to output_file */
+	Results *results;
+	/* Set by the pool: 0 on success, or SpiceInstance::ABORTED if the job was
+	stopped early, in which case its results so far are still written */
+	int status;
+	/* Set by the pool: time taken to load and run the circuit, in seconds */
+	double seconds;
+
+	SpiceJob() : netlist(NULL), results(NULL), status(0), seconds(0.0) {}
+};
+
+class SpicePool
+{
+public:
+	/* Constructor: size is capped at SpiceInstance::MAX_INSTANCES */
+	SpicePool(size_t size);
+	~SpicePool();
+
+	/* Load and initialize a copy of ngspice for each worker. Returns 0 on success. */
+	int init(const std::string &library = "libngspice.so");
+
+	/* Run all jobs, blocking until every job is finished. Returns the number of
+	failed jobs, counting jobs that were stopped early. */
+	int run(std::vector<SpiceJob> &jobs);
+
+	/* Passed on to every instance, see SpiceInstance::set_breakpoint_threshold */
+	void set_breakpoint_threshold(double threshold);
+
+	/* Passed on to every instance, see SpiceInstance::set_foreground_cost */
+	void set_foreground_cost(double cost);
+
+	/* Passed on to every instance, see SpiceInstance::set_output_sampling */
+	void set_output_sampling(const OutputSampling &sampling);
+
+	/* Passed on to every instance, see SpiceInstance::set_time_budget and the like */
+	void set_budgets(double seconds, unsigned long steps, double stall, const CancelToken *token);
+
+	size_t size() const { return this->instances.size(); }
+
+private:
+	std::vector<SpiceInstance*> instances;
+};
+
+#endif
@@ -0,0 +1,223 @@
+/*
+tablefile.cc
+------------
+Implement reading and writing of text and binary tables
+*/
+
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tablefile.h"
+
+static const char MAGIC[8] = { 'L', 'P', 'N', 'B', 'C', 'T', 'B', '1' };
+
+struct BinaryHeader
+{
+	char magic[8];
+	uint32_t columns;
+	uint32_t header_length;
+	uint64_t rows;
+};
+
+static int
+parse_text(const char *begin, const char *end, Table &table, std::string &error);
+
+static int
+parse_line(const char *p, const char *end, Table &table, std::string &error);
+
+static int
+parse_binary(const char *begin, const char *end, Table &table, std::string &error);
+
+int read_table(const std::string &filename, Table &table, std::string &error)
+{
+	table.header.clear();
+	table.columns.clear();
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		error = filename + ": cannot open file";
+		return 1;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		error = filename + ": file is empty";
+		return 1;
+	}
+	size_t size = info.st_size;
+	void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		error = filename + ": cannot map file";
+		return 1;
+	}
+	madvise(data, size, MADV_SEQUENTIAL);
+
+	const char *begin = static_cast<const char*>(data);
+	int ret;
+	if (size >= sizeof(MAGIC) && memcmp(begin, MAGIC, sizeof(MAGIC)) == 0)
+		ret = parse_binary(begin, begin + size, table, error);
+	else
+		ret = parse_text(begin, begin + size, table, error);
+	munmap(data, size);
+
+	if (ret == 0 && table.rows() == 0) {
+		error = ": no rows";
+		ret = 1;
+	}
+	if (ret != 0) error = filename + error;
+	return ret;
+}
+
+int write_binary_table(const std::string &filename, const Table &table)
+{
+	BinaryHeader header;
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.columns = table.columns.size();
+	header.header_length = table.header.length();
+	header.rows = table.rows();
+
+	std::ofstream out(filename.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(table.header.data(), table.header.length());
+	for (auto const& column : table.columns)
+		out.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(double));
+	out.flush();
+	return out ? 0 : 1;
+}
+
+void write_text_table(std::ostream &out, const Table &table)
+{
+	std::streamsize precision = out.precision(std::numeric_limits<double>::max_digits10);
+	if (!table.header.empty()) out << table.header << "\n";
+	for (size_t row = 0; row < table.rows(); row++) {
+		for (size_t column = 0; column < table.columns.size(); column++)
+			out << (column == 0 ? "" : "\t") << table.columns[column][row];
+		out << "\n";
+	}
+	out.precision(precision);
+}
+
+/* Parse every line of the text in [begin, end). Lines are found with memchr
+and numbers read with strtod where they lie. strtod needs the text after a
+number to stop it, so only a last line with no newline is copied. The error
+message is prefixed with the line number. */
+static int
+parse_text(const char *begin, const char *end, Table &table, std::string &error)
+{
+    // a row per line at most, which saves growing the columns one at a time
+    size_t lines = 1;
+    for (const char *p = begin; (p = static_cast<const char*>(memchr(p, '\n', end - p))); p++)
+        lines++;
+
+    size_t line_number = 0;
+    for (const char *p = begin; p < end; ) {
+        line_number++;
+        const char *newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        int ret;
+        if (newline) {
+            ret = parse_line(p, newline, table, error);
+            p = newline + 1;
+        } else {
+            std::string last(p, end);
+            ret = parse_line(last.c_str(), last.c_str() + last.length(), table, error);
+            p = end;
+        }
+        if (ret != 0) {
+            std::ostringstream message;
+            message << ":" << line_number << ": " << error;
+            error = message.str();
+            return 1;
+        }
+        if (table.rows() == 1 && table.columns[0].capacity() < lines) {
+            for (auto &column : table.columns)
+                column.reserve(lines);
+        }
+    }
+    return 0;
+}
+
+/* Parse the line [p, end) into a new row of table, or its header */
+static int
+parse_line(const char *p, const char *end, Table &table, std::string &error)
+{
+    while (p < end && isspace(static_cast<unsigned char>(*p))) p++;
+    if (p == end || *p == '#') return 0;
+
+    if (isalpha(static_cast<unsigned char>(*p)) && table.rows() == 0 && table.header.empty()) {
+        const char *last = end;
+        while (last > p && isspace(static_cast<unsigned char>(last[-1]))) last--;
+        table.header.assign(p, last);
+        return 0;
+    }
+
+    bool first_row = table.columns.empty();
+    size_t column = 0;
+    while (p < end) {
+        char *number_end;
+        double value = strtod(p, &number_end);
+        if (number_end == p || number_end > end ||
+            (number_end < end && !isspace(static_cast<unsigned char>(*number_end)))) {
+            const char *token_end = p;
+            while (token_end < end && !isspace(static_cast<unsigned char>(*token_end))) token_end++;
+            error = "'" + std::string(p, token_end) + "' is not a number";
+            return 1;
+        }
+        if (first_row) {
+            table.columns.push_back(std::vector<double>());
+        } else if (column >= table.columns.size()) {
+            std::ostringstream message;
+            message << "expected " << table.columns.size() << " numbers, found more";
+            error = message.str();
+            return 1;
+        }
+        table.columns[column++].push_back(value);
+        p = number_end;
+        while (p < end && isspace(static_cast<unsigned char>(*p))) p++;
+    }
+    if (column < table.columns.size()) {
+        std::ostringstream message;
+        message << "expected " << table.columns.size() << " numbers, found " << column;
+        error = message.str();
+        return 1;
+    }
+    return 0;
+}
+
+/* Copy the columns of a binary table in [begin, end) into table */
+static int
+parse_binary(const char *begin, const char *end, Table &table, std::string &error)
+{
+    BinaryHeader header;
+    size_t size = end - begin;
+    if (size < sizeof(header)) {
+        error = ": binary table header is cut short";
+        return 1;
+    }
+    memcpy(&header, begin, sizeof(header));
+    size_t data = sizeof(header) + header.header_length;
+    if (header.columns == 0 || data > size ||
+        header.rows > (size - data) / sizeof(double) / header.columns) {
+        error = ": binary table is cut short";
+        return 1;
+    }
+
+    table.header.assign(begin + sizeof(header), header.header_length);
+    table.columns.resize(header.columns);
+    for (uint32_t i = 0; i < header.columns; i++) {
+        table.columns[i].resize(header.rows);
+        memcpy(table.columns[i].data(), begin + data + i * header.rows * sizeof(double),
+            header.rows * sizeof(double));
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+/*
+TableFile.h
+-----------
+Read and write the tables of numbers that boundary condition files hold.
+
+A text table has one row per line, with numbers separated by spaces or tabs.
+Blank lines and lines starting with '#' are skipped. A first line starting
+with a letter is not a row but the header of the table (e.g. "fourier 1.0").
+Every row must have as many numbers as the first. The file is mapped into
+memory and parsed where it lies, so lines are not copied and may be of any
+length.
+
+A binary table holds the same numbers, so that it loads without parsing:
+
+<8 bytes "LPNBCTB1"> <uint32 columns> <uint32 header length> <uint64 rows>
+<header> <float64 column 0...> <float64 column 1...> ...
+
+in the byte order of the machine. read_table() tells the two apart by the
+first 8 bytes, whatever the file is called.
+*/
+#include <string>
+#include <vector>
+#include <iostream>
+
+#ifndef __TABLEFILE_H__
+#define __TABLEFILE_H__
+
+struct Table
+{
+	std::string header;
+	std::vector<std::vector<double> > columns;
+
+	size_t rows() const { return this->columns.empty() ? 0 : this->columns[0].size(); }
+};
+
+/* Read a text or binary table. Returns 0 on success, or 1 with error set to a
+message naming the file, and for text tables the line, that could not be read. */
+int read_table(const std::string &filename, Table &table, std::string &error);
+
+/* Write table as a binary table. Returns 0 on success. */
+int write_binary_table(const std::string &filename, const Table &table);
+
+/* Write table as a text table, with every number printed exactly */
+void write_text_table(std::ostream &out, const Table &table);
+
+#endif
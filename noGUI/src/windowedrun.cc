@@ -0,0 +1,161 @@
+/*
+windowedrun.cc
+--------------
+Implement WindowedRun class
+*/
+
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "windowedrun.h"
+
+int WindowedRun::run(Netlist &netlist, double window, std::ostream &out,
+	const std::vector<std::string> &vectors, const Checkpoint *resume)
+{
+	double step, stop;
+	bool uic;
+	if (netlist.get_transient(step, stop, uic) != 0) {
+		std::cout << "Error: windowed runs need a .tran line" << std::endl;
+		return 1;
+	}
+	if (window <= 0 || step <= 0) {
+		std::cout << "Error: invalid window or time step" << std::endl;
+		return 1;
+	}
+
+	// The state vectors must be kept even if only some vectors are written
+	if (!vectors.empty()) {
+		std::vector<std::string> save(vectors);
+		std::vector<std::string> state = netlist.get_state_vectors();
+		save.insert(save.end(), state.begin(), state.end());
+		netlist.add_save(save);
+	}
+
+	size_t windows = (size_t) std::ceil(stop / window - 1e-9);
+	Checkpoint checkpoint;
+	checkpoint.window = window;
+	checkpoint.step = step;
+	size_t first = 0;
+	if (resume) {
+		if (resume->window != window || resume->step != step) {
+			std::cout << "Error: the checkpoint was taken with a different window or time step"
+				<< std::endl;
+			return 1;
+		}
+		first = resume->next_window;
+		checkpoint.output_offset = resume->output_offset;
+		netlist.set_initial_conditions(resume->node_voltages, resume->inductor_currents);
+		std::cout << "Resuming at window " << first + 1 << " of " << windows << " (t = "
+			<< resume->time << "s)" << std::endl;
+	}
+
+	double period = netlist.get_max_period();
+	for (size_t k = first; k < windows; k++) {
+		double offset = k * window;
+		double length = std::min(window, stop - offset);
+
+		std::ostringstream tran;
+		tran.precision(17);
+		tran << ".tran " << step << " " << length;
+		if (k > 0 || uic) tran << " uic";
+		netlist.set_analysis(tran.str());
+
+		Results results;
+		this->instance->set_time_offset(offset);
+		int ret = this->instance->load(&netlist);
+		if (ret == 0) ret = this->instance->run();
+		// A window stopped early is written as far as it got, and ends the run
+		bool aborted = (ret == SpiceInstance::ABORTED);
+		if (aborted) ret = 0;
+		if (ret == 0) ret = this->instance->get_results(results);
+		this->instance->clear();
+		if (ret != 0) {
+			std::cout << "Error running window " << k + 1 << " of " << windows << std::endl;
+			this->instance->set_time_offset(0.0);
+			return 1;
+		}
+
+		checkpoint.node_voltages.clear();
+		checkpoint.inductor_currents.clear();
+		get_final_state(results, checkpoint.node_voltages, checkpoint.inductor_currents);
+		netlist.set_initial_conditions(checkpoint.node_voltages, checkpoint.inductor_currents);
+
+		SimVector *time = results.find("time");
+		if (time) {
+			for (double &t : time->data)
+				t += offset;
+		}
+		// The table is built in memory to count the bytes written for checkpoints
+		std::ostringstream table;
+		if (vectors.empty()) {
+			results.write_table(table, k == 0, k == 0 ? 0 : 1);
+		} else {
+			Results selected;
+			if (time) selected.vectors.push_back(*time);
+			for (const std::string &name : vectors) {
+				const SimVector *v = results.find(name);
+				if (v) selected.vectors.push_back(*v);
+			}
+			selected.write_table(table, k == 0, k == 0 ? 0 : 1);
+		}
+		const std::string &text = table.str();
+		out.write(text.data(), text.length());
+		out.flush();
+		if (!out) {
+			std::cout << "Error writing output" << std::endl;
+			this->instance->set_time_offset(0.0);
+			return 1;
+		}
+
+		if (aborted) {
+			std::cout << "Window " << k + 1 << " of " << windows << " stopped early" << std::endl;
+			this->instance->set_time_offset(0.0);
+			return SpiceInstance::ABORTED;
+		}
+
+		checkpoint.next_window = k + 1;
+		checkpoint.time = offset + length;
+		checkpoint.phase = period > 0 ? std::fmod(checkpoint.time, period) : 0.0;
+		checkpoint.output_offset += text.length();
+		if (!this->checkpoint_file.empty() && checkpoint.write(this->checkpoint_file) != 0) {
+			std::cout << "Error writing checkpoint " << this->checkpoint_file << std::endl;
+			this->instance->set_time_offset(0.0);
+			return 1;
+		}
+
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		std::cout << "Window " << k + 1 << " of " << windows << " (t = " << offset << " to "
+			<< offset + length << "s) done, peak memory " << usage.ru_maxrss / 1024 << " MB"
+			<< std::endl;
+	}
+	this->instance->set_time_offset(0.0);
+	return 0;
+}
+
+void WindowedRun::get_final_state(const Results &results,
+	std::map<std::string, double> &node_voltages,
+	std::map<std::string, double> &inductor_currents)
+{
+	for (const SimVector &v : results.vectors) {
+		if (v.data.empty() || v.name == "time") continue;
+
+		std::string name(v.name);
+		for (size_t i = 0; i < name.length(); i++)
+			name[i] = std::tolower(name[i]);
+
+		size_t branch = name.find("#branch");
+		if (branch != std::string::npos) {
+			if (name[0] == 'l')
+				inductor_currents[name.substr(0, branch)] = v.data.back();
+		} else if (name.compare(0, 2, "v(") == 0 && name[name.length() - 1] == ')') {
+			node_voltages[name.substr(2, name.length() - 3)] = v.data.back();
+		} else if (name.find_first_of("(#") == std::string::npos) {
+			// Older versions of ngspice name node voltages by the node alone
+			node_voltages[name] = v.data.back();
+		}
+	}
+}
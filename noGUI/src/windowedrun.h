@@ -0,0 +1,62 @@
+/*
+WindowedRun.h
+-------------
+Class to run a long transient simulation as a series of shorter windows.
+
+Ngspice keeps every point of a run in memory until the plot is destroyed, so a
+long run grows without bound. A WindowedRun simulates one window at a time:
+it writes the points of the window to the output, reads the final value of
+every node voltage and inductor current, destroys the plot, and starts the
+next window from that state with .ic and uic. Memory then depends on the
+window length only.
+
+Boundary conditions are looked up with the time offset of the window, and the
+first point of each window after the first is dropped, since it repeats the
+last point of the one before. The output is a single ASCII table over the
+whole run.
+
+With a checkpoint file set, the state at the end of every window is saved to
+it (see Checkpoint), and a killed run can be continued from the last one.
+*/
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+#include "spiceinstance.h"
+#include "netlist.h"
+#include "results.h"
+#include "checkpoint.h"
+
+#ifndef __WINDOWEDRUN_H__
+#define __WINDOWEDRUN_H__
+
+class WindowedRun
+{
+public:
+	/* Constructor: instance must be initialized, and have no circuit loaded */
+	WindowedRun(SpiceInstance *instance) { this->instance = instance; }
+
+	/* Run the transient analysis of netlist in windows of the given length, and
+	write the given vectors (or all of them, if empty) as an ASCII table to out.
+	If resume is given, the run continues from it instead of starting at time 0,
+	and out must already hold the output_offset bytes written before it.
+	The netlist is modified. Returns 0 on success, or SpiceInstance::ABORTED if a window
+	was stopped early; it is written as far as it got, with no checkpoint after it. */
+	int run(Netlist &netlist, double window, std::ostream &out,
+		const std::vector<std::string> &vectors, const Checkpoint *resume = NULL);
+
+	/* Save a checkpoint to filename after every window, or none if empty */
+	void set_checkpoint_file(const std::string &filename) { this->checkpoint_file = filename; }
+
+private:
+	SpiceInstance *instance;
+	std::string checkpoint_file;
+
+	/* Read the last value of every node voltage and inductor current */
+	static void get_final_state(const Results &results,
+		std::map<std::string, double> &node_voltages,
+		std::map<std::string, double> &inductor_currents);
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+bcconvert.cc
+------------
+Convert boundary condition files between text and binary tables (see
+src/tablefile.h). A binary table loads without parsing, which helps with
+large or finely sampled waveforms. The input may be either kind; the output
+is binary unless -t is given.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "../src/tablefile.h"
+
+using namespace std;
+
+static void
+print_usage()
+{
+    cout << "Usage: ./bcconvert [-t] <input file> <output file>" << endl;
+    cout << "  -t, --text            write a text table instead of a binary one" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    bool text = false;
+    string input, output;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-t" || arg == "--text") {
+            text = true;
+        } else if (arg[0] != '-' && input.empty()) {
+            input = arg;
+        } else if (arg[0] != '-' && output.empty()) {
+            output = arg;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (input.empty() || output.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    Table table;
+    string error;
+    if (read_table(input, table, error) != 0) {
+        cout << error << endl;
+        return 1;
+    }
+
+    if (text) {
+        ofstream out(output.c_str());
+        write_text_table(out, table);
+        if (!out) {
+            cout << "Could not write " << output << endl;
+            return 1;
+        }
+    } else if (write_binary_table(output, table) != 0) {
+        cout << "Could not write " << output << endl;
+        return 1;
+    }
+    cout << "Wrote " << table.rows() << " rows of " << table.columns.size() << " columns to "
+        << output << endl;
+    return 0;
+}
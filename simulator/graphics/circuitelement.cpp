@@ -356,6 +356,16 @@ void CircuitElement::processDialogInput()
                                  "<value>. Please provide a valid file.");
             externalFile = "";
             valueFileLineEdit->setText("");
+        } else if (BoundaryCondition::findColumn(BoundaryCondition::tableColumns(externalFile),
+                                                 prefix + name) < 0) {
+            QMessageBox::warning(nullptr,
+                                 "Bad Input File",
+                                 "The input file provided has several value "
+                                 "columns, but none named " + prefix +
+                                 name.left(name.length() - 3) + ". Please "
+                                 "provide a valid file.");
+            externalFile = "";
+            valueFileLineEdit->setText("");
         }
     // Constant input
     } else {
@@ -475,6 +475,10 @@ void Schematic::parseSchematic()
         case Netlist::DuplicateNameError:
             errormsg = "Duplicate element names. All element names must be unique.";
             break;
+        case Netlist::NoColumnError:
+            errormsg = "An external element was given a table with several value "
+                       "columns, none of them named after it.";
+            break;
         case -1:
             errormsg = "Unknown error occurred.";
         }
@@ -1,112 +1,1045 @@
+#include <algorithm>
+#include <climits>
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
 #include "boundarycondition.h"
 
+constexpr double BoundaryCondition::defaultBreakpointThreshold;
+
+QMutex BoundaryCondition::cacheMutex;
+QHash<QString, BoundaryCondition::FileState> BoundaryCondition::cachedFiles;
+QMap<QPair<quint64, qint64>, BoundaryCondition::Table> BoundaryCondition::cachedTables;
+int BoundaryCondition::cacheCapacity = 0;
+int BoundaryCondition::cacheHits = 0;
+int BoundaryCondition::cacheMisses = 0;
+quint64 BoundaryCondition::cacheClock = 0;
+
 /* Constructor: BoundaryCondition(QString, QObject *)
  * -------------------------------------------------
  * Create a new BoundaryCondition object with values
- * given in the file named by argument filename.
+ * given in the file named by argument filename. The
+ * file is only parsed if it has not been read before
+ * (see loadTable()).
  *
  * Emits signal badFile() if file is not properly
  * formatted.
  *
  * Period is determined to be the largest time value
- * given in the file plus one time step
+ * given in the file plus one time step, or read from
+ * the header of a Fourier series file.
  */
 BoundaryCondition::BoundaryCondition(QString filename,
                                      QObject *parent) : QObject(parent)
 {
-    QFile file(filename);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    QFileInfo info(filename);
+    sourcePath = info.absoluteFilePath();
+    sourceModified = info.lastModified();
+    sourceSize = info.exists() ? info.size() : -1;
+    Table table;
+    if (!loadTable(filename, table, loadError)) {
+        if (loadError.isEmpty()) loadError = "Could not read " + filename;
+        emit badFile();
         return;
+    }
 
-    qreal maxTime = 0;
-    qreal step = 0;
-    QTextStream in(&file);
-    while (!in.atEnd()) {
-        QString line = in.readLine();
-        QStringList tokens = line.split(QRegExp("\\s+"));
-        if (tokens.length() != 2) {
-            emit badFile();
-            return;
+    // the vectors are implicitly shared with the cache, not copied
+    times = table.times;
+    values = table.values;
+    names = table.names;
+    period = table.period;
+    cosines = table.cosines;
+    sines = table.sines;
+    if (isFourier()) return;
+    valueColumns = values.size() / times.size();
+    states.resize(valueColumns);
+    findGridStep();
+    findSlopeChanges();
+}
+
+// ============== STATIC METHODS ===============================================
+
+/* Static method: findColumn(const QStringList &, QString)
+ * --------------------------------------------------------
+ * Returns the index in columns, the value column names
+ * of a table, of the column the element named name
+ * reads: the one of its name, ignoring case and the
+ * _dt suffix the schematic gives external elements.
+ * A table with at most one value column gives 0 to
+ * every element, and one with several returns -1 if
+ * none is named after the element.
+ */
+int BoundaryCondition::findColumn(const QStringList &columns, QString name)
+{
+    if (columns.size() <= 1) return 0;
+    QString base = name;
+    if (base.endsWith("_dt", Qt::CaseInsensitive)) base.chop(3);
+    for (int c = 0; c < columns.size(); c++) {
+        if (columns[c].compare(name, Qt::CaseInsensitive) == 0 ||
+                columns[c].compare(base, Qt::CaseInsensitive) == 0)
+            return c;
+    }
+    return -1;
+}
+
+/* Static method: load(QString)
+ * ----------------------------
+ * Read and check the given file in one pass, returning
+ * a new BoundaryCondition for it, or one that is not
+ * isValid() if the file can not be used. Safe to call
+ * from any thread: the condition is handed to the
+ * thread of the application, for the caller to own.
+ */
+BoundaryCondition *BoundaryCondition::load(QString filename)
+{
+    BoundaryCondition *bc = new BoundaryCondition(filename);
+    if (QCoreApplication::instance() != nullptr)
+        bc->moveToThread(QCoreApplication::instance()->thread());
+    return bc;
+}
+
+/* Static method: buildTable(const QByteArray &,
+ * const QVector<QVector<double>> &, Table &)
+ * ---------------------------------------------
+ * Fill table from the header and columns of a file
+ * that passed checkTable(). Rows are sorted by time,
+ * keeping the last row given for a repeated time;
+ * files already in increasing order are taken as
+ * they are.
+ */
+void BoundaryCondition::buildTable(const QByteArray &header,
+                                   const QVector<QVector<double>> &columns,
+                                   Table &table)
+{
+    if (header.startsWith("fourier")) {
+        table.period = header.mid(7).trimmed().toDouble();
+        for (int row = 0; row < columns[0].size(); row++) {
+            int k = static_cast<int>(columns[0][row]);
+            if (table.cosines.size() <= k) {
+                table.cosines.resize(k + 1);
+                table.sines.resize(k + 1);
+            }
+            table.cosines[k] = columns[1][row];
+            table.sines[k] = columns[2][row];
         }
-        bool ok;
-        qreal time = tokens[0].toDouble(&ok);
-        if (!ok) {
-            emit badFile();
-            return;
+        return;
+    }
+
+    int valueColumns = columns.size() - 1;
+    if (!header.isEmpty())
+        table.names = QString(header).split(QRegExp("\\s+"), QString::SkipEmptyParts).mid(1);
+
+    const QVector<double> &fileTimes = columns[0];
+    bool increasing = true;
+    for (int i = 1; i < fileTimes.size() && increasing; i++)
+        increasing = fileTimes[i - 1] < fileTimes[i];
+    if (increasing) {
+        table.times = fileTimes;
+        for (int c = 1; c <= valueColumns; c++)
+            table.values += columns[c];
+    } else {
+        QMap<qreal, int> rows;
+        for (int i = 0; i < fileTimes.size(); i++)
+            rows[fileTimes[i]] = i;
+        table.times = rows.keys().toVector();
+        for (int c = 1; c <= valueColumns; c++) {
+            foreach (int row, rows)
+                table.values.append(columns[c][row]);
         }
-        step = time - maxTime;
-        maxTime = time > maxTime ? time : maxTime;
-        states[time] = tokens[1].toDouble(&ok);
-        if (!ok) {
-            emit badFile();
-            return;
+    }
+    int n = table.times.size();
+    double step = n > 1 ? table.times[n - 1] - table.times[n - 2] : table.times[0];
+    table.period = table.times.last() + step;
+}
+
+/* Static method: loadTable(QString, Table &, QString &)
+ * ------------------------------------------------------
+ * Fill table from the given file, parsing it only if
+ * it has not been read before. Files are known by
+ * their path, modification time and size, and by a
+ * hash of their contents: a path unchanged since it
+ * was read is found without reading it, and a file
+ * with the same contents as one read before (a copy,
+ * or a file saved again unchanged) is not parsed
+ * again. The vectors of a table are implicitly shared
+ * by every BoundaryCondition made from it. Returns
+ * false with error set if the file can not be used.
+ */
+bool BoundaryCondition::loadTable(QString filename, Table &table, QString &error)
+{
+    QFileInfo info(filename);
+    QString path = info.absoluteFilePath();
+    QMutexLocker locker(&cacheMutex);
+    FileState state;
+    if (info.exists() && cachedFiles.contains(path) &&
+            cachedFiles[path].modified == info.lastModified() &&
+            cachedFiles[path].size == info.size()) {
+        state = cachedFiles[path];
+    } else {
+        // hash without holding the lock, as the file may be large
+        locker.unlock();
+        bool hashed = hashFile(filename, state);
+        locker.relock();
+        if (hashed) {
+            state.modified = info.lastModified();
+            cachedFiles[path] = state;
         }
     }
-    this->period = maxTime + step;
+
+    QPair<quint64, qint64> key(state.hash, state.size);
+    if (state.size > 0 && cachedTables.contains(key)) {
+        cacheHits++;
+        cachedTables[key].lastUsed = ++cacheClock;
+        table = cachedTables[key];
+        return true;
+    }
+
+    cacheMisses++;
+    locker.unlock();
+    QByteArray header;
+    QVector<QVector<double>> columns;
+    if (!readTable(filename, header, columns, error) ||
+            !checkTable(header, columns, error))
+        return false;
+    buildTable(header, columns, table);
+    if (state.size == 0) return true;
+
+    locker.relock();
+    table.lastUsed = ++cacheClock;
+    cachedTables[key] = table;
+    evictTables();
+    return true;
 }
 
-// ============== STATIC METHODS ===============================================
+/* Static method: hashFile(QString, FileState &)
+ * ----------------------------------------------
+ * Set the size and 64-bit FNV-1a hash of the contents
+ * of the given file. Returns false if it can not be
+ * read.
+ */
+bool BoundaryCondition::hashFile(QString filename, FileState &state)
+{
+    state.size = 0;
+    state.hash = 0;
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) return false;
+    qint64 size = file.size();
+    const uchar *bytes = file.map(0, size);
+    if (bytes == nullptr) return false;
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    for (qint64 i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= Q_UINT64_C(1099511628211);
+    }
+    state.size = size;
+    state.hash = hash;
+    return true;
+}
 
-/* Static method: checkFile(QString)
- * ---------------------------------
+/* Static method: evictTables()
+ * ----------------------------
+ * Forget the least recently used tables until at most
+ * cacheCapacity are left. Called with cacheMutex held.
+ */
+void BoundaryCondition::evictTables()
+{
+    while (cacheCapacity > 0 && cachedTables.size() > cacheCapacity) {
+        QMap<QPair<quint64, qint64>, Table>::iterator oldest = cachedTables.begin();
+        for (auto it = cachedTables.begin(); it != cachedTables.end(); ++it) {
+            if (it->lastUsed < oldest->lastUsed) oldest = it;
+        }
+        cachedTables.erase(oldest);
+    }
+}
+
+/* Static method: setCacheCapacity(int)
+ * ------------------------------------
+ * Keep at most capacity tables read from files,
+ * forgetting the least recently used first. 0, the
+ * default, keeps every one.
+ */
+void BoundaryCondition::setCacheCapacity(int capacity)
+{
+    QMutexLocker locker(&cacheMutex);
+    cacheCapacity = capacity;
+    evictTables();
+}
+
+/* Static method: cacheHitCount() and cacheMissCount()
+ * ---------------------------------------------------
+ * Number of files found among the tables already read,
+ * and number parsed.
+ */
+int BoundaryCondition::cacheHitCount()
+{
+    QMutexLocker locker(&cacheMutex);
+    return cacheHits;
+}
+
+int BoundaryCondition::cacheMissCount()
+{
+    QMutexLocker locker(&cacheMutex);
+    return cacheMisses;
+}
+
+/* Static method: checkFile(QString, QString *)
+ * --------------------------------------------
  * Returns true if file is properly formatted
  * i.e. every line is of the form <time>\t<value>
- * where <time> and <value> are numeric.
- */
- bool BoundaryCondition::checkFile(QString filename)
-{
-     QFile file(filename);
-     if (!file.open(QFile::ReadOnly | QIODevice::Text)) return false;
-     QTextStream in(&file);
-     bool ok = true;
-     while(!in.atEnd()){
-         QStringList tokens = in.readLine().split(QRegExp("\\s+"));
-         if (tokens.length() != 2) {
-             ok = false;
-             break;
-         }
-         tokens[0].toDouble(&ok);
-         if (!ok) break;
-         tokens[1].toDouble(&ok);
-         if (!ok) break;
-     }
-     file.close();
-     return ok;
+ * where <time> and <value> are numeric, or it is a
+ * Fourier series file or a binary table. Otherwise
+ * sets error, if given, to a message naming the line
+ * at fault. The table read is kept, so a
+ * BoundaryCondition made from the file afterwards does
+ * not parse it again.
+ */
+bool BoundaryCondition::checkFile(QString filename, QString *error)
+{
+    Table table;
+    QString message;
+    bool ok = loadTable(filename, table, message);
+    if (!ok && error != nullptr) *error = message;
+    return ok;
+}
+
+/* Static method: checkTable(const QByteArray &,
+ * const QVector<QVector<double>> &, QString &)
+ * ---------------------------------------------
+ * Returns true if the table read from a file is a
+ * boundary condition: two columns of times and values,
+ * a time column and value columns named by a header
+ * line, or a header "fourier <period>" and lines
+ * <k> <a_k> <b_k>.
+ */
+bool BoundaryCondition::checkTable(const QByteArray &header,
+                                   const QVector<QVector<double>> &columns,
+                                   QString &error)
+{
+    if (header.isEmpty()) {
+        if (columns.size() == 2) return true;
+        if (columns.size() > 2)
+            error = "Name the value columns in a header line "
+                    "<time> <name 1> <name 2> ...";
+        else
+            error = "Expected lines of the form <time> <value>";
+        return false;
+    }
+    if (!header.startsWith("fourier")) {
+        int named = QString(header).split(QRegExp("\\s+"), QString::SkipEmptyParts).size();
+        if (columns.size() >= 2 && named == columns.size()) return true;
+        error = QString("The header line names %1 columns, the table has %2")
+                .arg(named).arg(columns.size());
+        return false;
+    }
+    bool ok;
+    double period = header.mid(7).trimmed().toDouble(&ok);
+    if (!ok || period <= 0) {
+        error = "A Fourier series needs a header line fourier <period>";
+        return false;
+    }
+    if (columns.size() != 3) {
+        error = "A Fourier series has lines of the form <k> <a_k> <b_k>";
+        return false;
+    }
+    foreach (double k, columns[0]) {
+        if (k < 0 || k > 1e6 || k != qFloor(k)) {
+            error = "Harmonic numbers must be whole numbers from 0";
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Static method: readTable(QString, QByteArray &,
+ * QVector<QVector<double>> &, QString &)
+ * -----------------------------------------------
+ * Read the columns of numbers in a file, with an
+ * optional header line starting with a letter. Blank
+ * lines and lines starting with # are skipped, and
+ * every line must have as many numbers as the first.
+ *
+ * The file is mapped into memory and parsed where it
+ * lies, so lines are not copied and may be of any
+ * length. A file starting with the 8 bytes LPNBCTB1 is
+ * a binary table, as written by the noGUI bcconvert
+ * tool:
+ *   <8 bytes "LPNBCTB1"> <uint32 columns>
+ *   <uint32 header length> <uint64 rows> <header>
+ *   <float64 column 0...> <float64 column 1...> ...
+ * Returns false with error naming the line at fault
+ * if the file can not be read.
+ */
+bool BoundaryCondition::readTable(QString filename, QByteArray &header,
+                                  QVector<QVector<double>> &columns,
+                                  QString &error)
+{
+    header.clear();
+    columns.clear();
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = "Cannot open " + filename;
+        return false;
+    }
+    qint64 size = file.size();
+    if (size == 0) {
+        error = filename + " is empty";
+        return false;
+    }
+    const char *begin = reinterpret_cast<const char *>(file.map(0, size));
+    if (begin == nullptr) {
+        error = "Cannot read " + filename;
+        return false;
+    }
+    const char *end = begin + size;
+
+    bool ok;
+    if (size >= 8 && memcmp(begin, "LPNBCTB1", 8) == 0)
+        ok = parseBinary(begin, end, header, columns, error);
+    else
+        ok = parseText(begin, end, header, columns, error);
+    if (ok && (columns.isEmpty() || columns[0].isEmpty())) {
+        error = "No lines of numbers";
+        ok = false;
+    }
+    if (!ok) error = QFileInfo(filename).fileName() + ": " + error;
+    return ok;
+}
+
+/* Static method: parseText(const char *, const char *,
+ * QByteArray &, QVector<QVector<double>> &, QString &)
+ * ----------------------------------------------------
+ * Parse the lines of text in [begin, end). Numbers are
+ * read with strtod_l in the C locale where they lie;
+ * only a last line without a newline is copied, so
+ * that strtod_l stops at its end.
+ */
+bool BoundaryCondition::parseText(const char *begin, const char *end,
+                                  QByteArray &header,
+                                  QVector<QVector<double>> &columns,
+                                  QString &error)
+{
+    int lines = 1;
+    for (const char *p = begin;
+         (p = static_cast<const char *>(memchr(p, '\n', end - p))); p++)
+        lines++;
+
+    int lineNumber = 0;
+    for (const char *p = begin; p < end; ) {
+        lineNumber++;
+        const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+        bool ok;
+        if (newline) {
+            ok = parseLine(p, newline, header, columns, error);
+            p = newline + 1;
+        } else {
+            QByteArray last(p, end - p);
+            ok = parseLine(last.constData(), last.constData() + last.size(),
+                           header, columns, error);
+            p = end;
+        }
+        if (!ok) {
+            error = QString("line %1: %2").arg(lineNumber).arg(error);
+            return false;
+        }
+        if (!columns.isEmpty() && columns[0].size() == 1) {
+            for (int i = 0; i < columns.size(); i++)
+                columns[i].reserve(lines);
+        }
+    }
+    return true;
+}
+
+/* Static method: parseLine(const char *, const char *,
+ * QByteArray &, QVector<QVector<double>> &, QString &)
+ * ----------------------------------------------------
+ * Parse the line [p, end) into a new row of columns,
+ * or into header if it is the first line and starts
+ * with a letter.
+ */
+bool BoundaryCondition::parseLine(const char *p, const char *end,
+                                  QByteArray &header,
+                                  QVector<QVector<double>> &columns,
+                                  QString &error)
+{
+    static locale_t cLocale = newlocale(LC_ALL_MASK, "C", nullptr);
+    while (p < end && isspace(static_cast<unsigned char>(*p))) p++;
+    if (p == end || *p == '#') return true;
+
+    if (isalpha(static_cast<unsigned char>(*p)) && columns.isEmpty() && header.isEmpty()) {
+        header = QByteArray(p, end - p).trimmed();
+        return true;
+    }
+
+    bool firstRow = columns.isEmpty();
+    int column = 0;
+    while (p < end) {
+        char *numberEnd;
+        double value = strtod_l(p, &numberEnd, cLocale);
+        if (numberEnd == p || numberEnd > end ||
+                (numberEnd < end && !isspace(static_cast<unsigned char>(*numberEnd)))) {
+            const char *tokenEnd = p;
+            while (tokenEnd < end && !isspace(static_cast<unsigned char>(*tokenEnd)))
+                tokenEnd++;
+            error = "'" + QString::fromLatin1(p, tokenEnd - p) + "' is not a number";
+            return false;
+        }
+        if (firstRow) {
+            columns.append(QVector<double>());
+        } else if (column >= columns.size()) {
+            error = QString("expected %1 numbers, found more").arg(columns.size());
+            return false;
+        }
+        columns[column++].append(value);
+        p = numberEnd;
+        while (p < end && isspace(static_cast<unsigned char>(*p))) p++;
+    }
+    if (column < columns.size()) {
+        error = QString("expected %1 numbers, found %2").arg(columns.size()).arg(column);
+        return false;
+    }
+    return true;
+}
+
+/* Static method: parseBinary(const char *, const char *,
+ * QByteArray &, QVector<QVector<double>> &, QString &)
+ * ------------------------------------------------------
+ * Copy the columns of the binary table in [begin, end).
+ */
+bool BoundaryCondition::parseBinary(const char *begin, const char *end,
+                                    QByteArray &header,
+                                    QVector<QVector<double>> &columns,
+                                    QString &error)
+{
+    quint32 count, headerLength;
+    quint64 rows;
+    const size_t fixed = 8 + 2 * sizeof(quint32) + sizeof(quint64);
+    size_t size = end - begin;
+    if (size < fixed) {
+        error = "binary table header is cut short";
+        return false;
+    }
+    memcpy(&count, begin + 8, sizeof(count));
+    memcpy(&headerLength, begin + 12, sizeof(headerLength));
+    memcpy(&rows, begin + 16, sizeof(rows));
+    size_t data = fixed + headerLength;
+    if (count == 0 || data > size || rows > (size - data) / sizeof(double) / count
+            || rows > INT_MAX) {
+        error = "binary table is cut short";
+        return false;
+    }
+
+    header = QByteArray(begin + fixed, headerLength);
+    columns.resize(count);
+    for (quint32 i = 0; i < count; i++) {
+        columns[i].resize(static_cast<int>(rows));
+        memcpy(columns[i].data(), begin + data + i * rows * sizeof(double),
+               rows * sizeof(double));
+    }
+    return true;
+}
+
+/* Static method: tableColumns(QString)
+ * -------------------------------------
+ * Returns the names of the value columns of a table
+ * file, or an empty list if the file can not be read
+ * or its columns are not named.
+ */
+QStringList BoundaryCondition::tableColumns(QString filename)
+{
+    Table table;
+    QString error;
+    if (!loadTable(filename, table, error)) return QStringList();
+    return table.names;
 }
 
 // ================= PUBLIC ====================================================
 
-/* Public Function: getState(double)
+/* Public Function: getState(double, int)
+ * ---------------------------------------
+ * Returns the voltage of the given value column at the
+ * given time. Every column is interpolated at once
+ * the first time a time is asked for, and the result
+ * kept for the other columns.
+ */
+double BoundaryCondition::getState(double time, int column)
+{
+    if (time == statesTime) return current[column];
+    const double *sample = sampleAt(time);
+    if (sample) {
+        current = sample;
+        statesTime = time;
+        return current[column];
+    }
+    if (isFourier()) return fourierState(time);
+    if (times.isEmpty()) return 0;
+    findStates(time);
+    current = states.constData();
+    statesTime = time;
+    return current[column];
+}
+
+/* Public Function: resample(double)
  * ---------------------------------
- * Returns the voltage at the given time
+ * Store the value of every column at each multiple of
+ * step in one period, for getState() to read at those
+ * times instead of interpolating. A period that is not
+ * a whole number of steps, or would need more than
+ * maxResampledValues values, is not resampled. A step
+ * of 0 drops the stored values.
  */
-double BoundaryCondition::getState(double time)
+void BoundaryCondition::resample(double step)
 {
-    QMap<qreal, qreal>::iterator high, low;
-    time = fmod(time, period);
-    high = states.lowerBound(time);
-    low = (high == states.begin() ? high : high--);
+    samples.clear();
+    samplePoints = 0;
+    statesTime = qQNaN();
+    if (step <= 0 || period <= 0 || (times.isEmpty() && !isFourier())) return;
+    double points = qRound64(period / step);
+    if (points < 1 || qAbs(points * step - period) > 1e-6 * step ||
+            points * valueColumns > maxResampledValues)
+        return;
+
+    int n = static_cast<int>(points);
+    QVector<double> resampled(n * valueColumns);
+    for (int k = 0; k < n; k++) {
+        for (int c = 0; c < valueColumns; c++)
+            resampled[k * valueColumns + c] = getState(k * step, c);
+    }
+    samples = resampled;
+    sampleScale = 1.0 / step;
+    samplePoints = n;
+    statesTime = qQNaN();
+}
+
+/* Public Function: fileChanged()
+ * -------------------------------
+ * Returns true if the file this condition was read
+ * from has been modified, removed or created since,
+ * judged by its modification time and size as for
+ * the table cache (see loadTable()).
+ */
+bool BoundaryCondition::fileChanged()
+{
+    QFileInfo info(sourcePath);
+    if (!info.exists()) return sourceSize != -1;
+    return info.lastModified() != sourceModified || info.size() != sourceSize;
+}
+
+/* Public Function: columnOf(QString)
+ * ----------------------------------
+ * Returns the index of the value column the element
+ * named name reads, as for findColumn().
+ */
+int BoundaryCondition::columnOf(QString name)
+{
+    return findColumn(names, name);
+}
+
+/* Public Function: nextKnot(double)
+ * ---------------------------------
+ * Returns the first time after the given time at
+ * which a value is given in the file, taking the
+ * period into account. Points within 1e-8 of time
+ * are skipped, as for positionBelow(). Only corners of
+ * a linear interpolation need to be stopped on, so
+ * otherwise returns infinity.
+ */
+double BoundaryCondition::nextKnot(double time)
+{
+    if (times.isEmpty() || interpolation != Linear) return qInf();
+    double base = qFloor(time / period) * period;
+    QVector<double>::const_iterator next =
+            std::upper_bound(times.constBegin(), times.constEnd(), time - base + 1e-8);
+    if (next == times.constEnd())
+        return base + period + times.first();
+    return base + *next;
+}
+
+/* Public Function: setInterpolation(Interpolation)
+ * -------------------------------------------------
+ * Interpolate the points of the file as given by
+ * mode, computing the coefficients of cubic segments.
+ * Files of fewer than 3 points, or whose period does
+ * not leave room after the last point, stay linear.
+ */
+void BoundaryCondition::setInterpolation(Interpolation mode)
+{
+    int n = times.size();
+    if (n < 3 || period <= times.last() - times.first()) mode = Linear;
+    interpolation = mode;
+    statesTime = qQNaN();
+    samples.clear();
+    firstOrder.clear();
+    secondOrder.clear();
+    thirdOrder.clear();
+    if (mode != Linear) {
+        firstOrder.resize(n * valueColumns);
+        secondOrder.resize(n * valueColumns);
+        thirdOrder.resize(n * valueColumns);
+    }
+    for (int c = 0; c < valueColumns; c++) {
+        if (mode == MonotoneCubic) findMonotoneCubic(c);
+        if (mode == PeriodicSpline) findPeriodicSpline(c);
+    }
+    // cubic segments have no corners to stop on
+    if (mode == Linear) findSlopeChanges();
+    else slopeChanges.clear();
+}
 
-    return interpolate(low, high, time);
+/* Public Function: breakpoints(double)
+ * -------------------------------------
+ * Returns the times in one period at which the slope
+ * of the interpolated value changes by at least
+ * threshold, relative to the steepest slope in the
+ * file. A slope reversing sign changes by at most 2,
+ * so a threshold above 2 returns no times.
+ */
+QList<double> BoundaryCondition::breakpoints(double threshold)
+{
+    QList<double> times;
+    for (int i = 0; i < slopeChanges.length(); i++) {
+        if (slopeChanges[i].second >= threshold)
+            times.append(slopeChanges[i].first);
+    }
+    return times;
 }
 
 // ================= PRIVATE ===================================================
 
-/* Private Function: interpolate(QMap<qreal, qreal>::iterator,
- * QMap<qreal, qreal>::iterator, double)
- * -----------------------------------------------------------
- * Return voltage at given time by linear interpolation of two
- * nearest values given by input file.
- */
-double BoundaryCondition::interpolate(
-        QMap<qreal, qreal>::iterator low,
-        QMap<qreal, qreal>::iterator high,
-        double time)
-{
-    if (qFabs(high.key() - time) <= 1e-8)
-        return high.value();
-    if (qFabs(low.key() - time) <= 1e-8)
-        return low.value();
-    return low.value() + (time - low.key())*
-            (high.value() - low.value())/(high.key() - low.key());
+/* Private Function: sampleAt(double)
+ * -----------------------------------
+ * Returns the resampled values at the given time if
+ * it is within 1e-6 steps of a multiple of the step,
+ * or nullptr if it is not or there are none.
+ */
+const double *BoundaryCondition::sampleAt(double time)
+{
+    if (samples.isEmpty()) return nullptr;
+    double x = time * sampleScale;
+    double k = std::nearbyint(x);
+    if (qAbs(x - k) > 1e-6 || k < 0) return nullptr;
+    qint64 point = static_cast<qint64>(k) % samplePoints;
+    return samples.constData() + point * valueColumns;
+}
+
+/* Private Function: findSlopeChanges()
+ * ------------------------------------
+ * Record the change of slope at every point, divided
+ * by the steepest slope in its column, taking the
+ * largest over the value columns. The last point
+ * joins the first point of the next period.
+ */
+void BoundaryCondition::findSlopeChanges()
+{
+    slopeChanges.clear();
+    int n = times.size();
+    if (n < 2) return;
+
+    QVector<double> changes(n, 0);
+    bool sloped = false;
+    for (int c = 0; c < valueColumns; c++) {
+        const double *v = values.constData() + c * n;
+        // slopes[i] joins point i to point i + 1, wrapping around at the end
+        QVector<double> slopes(n);
+        double steepest = 0;
+        for (int i = 0; i < n; i++) {
+            slopes[i] = (v[(i + 1) % n] - v[i]) / segmentWidth(i);
+            steepest = qMax(steepest, qFabs(slopes[i]));
+        }
+        if (steepest == 0) continue;
+        sloped = true;
+        for (int i = 0; i < n; i++) {
+            double in = slopes[(i + n - 1) % n];
+            changes[i] = qMax(changes[i], qFabs(slopes[i] - in) / steepest);
+        }
+    }
+    if (!sloped) return;
+
+    for (int i = 0; i < n; i++)
+        slopeChanges.append(qMakePair(times[i], changes[i]));
+}
+
+
+/* Private Function: fourierState(double)
+ * ---------------------------------------
+ * Sum the Fourier series at the given time. The cos
+ * and sin of each harmonic are found from those of
+ * the one below with the angle addition formulas.
+ */
+double BoundaryCondition::fourierState(double time)
+{
+    double theta = 2 * M_PI * fmod(time, period) / period;
+    double c1 = qCos(theta), s1 = qSin(theta);
+    double c = 1, s = 0;
+    double state = cosines[0];
+    for (int k = 1; k < cosines.size(); k++) {
+        double next = c * c1 - s * s1;
+        s = s * c1 + c * s1;
+        c = next;
+        state += cosines[k] * c + sines[k] * s;
+    }
+    return state;
+}
+
+/* Private Function: findGridStep()
+ * -------------------------------
+ * Set gridStep if every point lies within a millionth
+ * of a step of an evenly spaced grid from the first
+ * point to the last.
+ */
+void BoundaryCondition::findGridStep()
+{
+    int n = times.size();
+    if (n < 2) return;
+    double step = (times.last() - times.first()) / (n - 1);
+    if (step <= 0) return;
+    for (int i = 0; i < n; i++) {
+        if (qFabs(times[i] - (times[0] + i * step)) > 1e-6 * step)
+            return;
+    }
+    gridStep = step;
+    gridScale = 1 / step;
+}
+
+/* Private Function: findStates(double)
+ * --------------------------------------
+ * Set states to the voltage of every value column at
+ * the given time. For evenly spaced points the segment
+ * is found directly; otherwise the cursor is moved
+ * forward from the last time asked for, or placed by
+ * binary search if time went back or far ahead. The
+ * segment and the weights of its ends are found once
+ * for all the columns.
+ */
+void BoundaryCondition::findStates(double time)
+{
+    int n = times.size();
+    time = fmod(time, period);
+    if (time < 0) time += period;
+
+    Position position;
+    double x = (time - times[0]) * gridScale;
+    if (gridStep > 0 && x >= 0 && x < n - 1) {
+        position.i = static_cast<int>(x);
+        position.j = position.i + 1;
+        position.fraction = x - position.i;
+        position.h = position.fraction * gridStep;
+    } else if (gridStep > 0) {
+        position = positionBelow(x < 0 ? 0 : n, time);
+    } else {
+        // times[cursor - 1] <= time < times[cursor] once in place
+        int upper = cursor;
+        bool search = upper > n || (upper > 0 && times[upper - 1] > time);
+        for (int steps = 0; !search && upper < n && times[upper] <= time; steps++) {
+            if (steps == maxCursorSteps) search = true;
+            else upper++;
+        }
+        if (search)
+            upper = std::upper_bound(times.constBegin(), times.constEnd(), time)
+                    - times.constBegin();
+        cursor = upper;
+        position = positionBelow(upper, time);
+    }
+
+    const double *low = values.constData() + position.i;
+    const double *high = values.constData() + position.j;
+    if (interpolation == Linear) {
+        for (int c = 0; c < valueColumns; c++)
+            states[c] = low[c * n] + position.fraction * (high[c * n] - low[c * n]);
+        return;
+    }
+    double h = position.h;
+    const double *first = firstOrder.constData() + position.i;
+    const double *second = secondOrder.constData() + position.i;
+    const double *third = thirdOrder.constData() + position.i;
+    for (int c = 0; c < valueColumns; c++) {
+        int k = c * n;
+        states[c] = low[k] + h * (first[k] + h * (second[k] + h * third[k]));
+    }
+}
+
+/* Private Function: positionBelow(int, double)
+ * ---------------------------------------------
+ * Return where the given time falls, given the index
+ * of the first point after it. Before the first point
+ * or after the last, the last point is joined to the
+ * first point of the next period. A time within 1e-8
+ * of either end of its segment is taken to be on it.
+ */
+BoundaryCondition::Position BoundaryCondition::positionBelow(int upper, double time)
+{
+    int n = times.size();
+    Position position;
+    double start, end;
+    if (upper > 0 && upper < n) {
+        position.i = upper - 1;
+        position.j = upper;
+        start = times[upper - 1];
+        end = times[upper];
+    } else if (n < 2 || period <= times.last() - times.first()) {
+        position.i = position.j = (upper == 0) ? 0 : n - 1;
+        position.h = position.fraction = 0;
+        return position;
+    } else {
+        position.i = n - 1;
+        position.j = 0;
+        start = (upper == 0) ? times.last() - period : times.last();
+        end = (upper == 0) ? times.first() : times.first() + period;
+    }
+    position.h = time - start;
+    if (qFabs(end - time) <= 1e-8)
+        position.fraction = 1;
+    else if (qFabs(start - time) <= 1e-8)
+        position.fraction = 0;
+    else
+        position.fraction = position.h / (end - start);
+    return position;
+}
+
+/* Private Function: segmentWidth(int)
+ * ------------------------------------
+ * Length in time of segment i, from point i to the
+ * next, or to the first point of the next period.
+ */
+double BoundaryCondition::segmentWidth(int i)
+{
+    if (i == times.size() - 1) return times.first() + period - times.last();
+    return times[i + 1] - times[i];
+}
+
+/* Private Function: setHermiteCoefficients(int, const QVector<double> &)
+ * ----------------------------------------------------------------------
+ * Store the coefficients of the cubic on every segment
+ * of the given value column through the values at its
+ * ends with the given slopes at the points.
+ */
+void BoundaryCondition::setHermiteCoefficients(int column, const QVector<double> &slopes)
+{
+    int n = times.size();
+    int offset = column * n;
+    const double *v = values.constData() + offset;
+    for (int i = 0; i < n; i++) {
+        int j = (i + 1) % n;
+        double h = segmentWidth(i);
+        double secant = (v[j] - v[i]) / h;
+        firstOrder[offset + i] = slopes[i];
+        secondOrder[offset + i] = (3 * secant - 2 * slopes[i] - slopes[j]) / h;
+        thirdOrder[offset + i] = (slopes[i] + slopes[j] - 2 * secant) / (h * h);
+    }
+}
+
+/* Private Function: findMonotoneCubic(int)
+ * ----------------------------------------
+ * Fritsch-Carlson slopes for the given value column:
+ * the mean of the secants on either side of each
+ * point, or 0 where they differ in sign, limited so
+ * that each segment stays between the values at its
+ * ends.
+ */
+void BoundaryCondition::findMonotoneCubic(int column)
+{
+    int n = times.size();
+    const double *v = values.constData() + column * n;
+    QVector<double> secants(n), slopes(n);
+    for (int i = 0; i < n; i++)
+        secants[i] = (v[(i + 1) % n] - v[i]) / segmentWidth(i);
+    for (int i = 0; i < n; i++) {
+        double in = secants[(i + n - 1) % n];
+        double out = secants[i];
+        slopes[i] = (in * out <= 0) ? 0 : (in + out) / 2;
+    }
+    for (int i = 0; i < n; i++) {
+        int j = (i + 1) % n;
+        if (secants[i] == 0) {
+            slopes[i] = slopes[j] = 0;
+            continue;
+        }
+        double alpha = slopes[i] / secants[i];
+        double beta = slopes[j] / secants[i];
+        double length = alpha * alpha + beta * beta;
+        if (length > 9) {
+            double tau = 3 / qSqrt(length);
+            slopes[i] = tau * alpha * secants[i];
+            slopes[j] = tau * beta * secants[i];
+        }
+    }
+    setHermiteCoefficients(column, slopes);
+}
+
+/* Private Function: findPeriodicSpline(int)
+ * -----------------------------------------
+ * Solve the cyclic tridiagonal system for the second
+ * derivatives M of the periodic cubic spline of the
+ * given value column,
+ *   h[i-1] M[i-1] + 2 (h[i-1] + h[i]) M[i] + h[i] M[i+1]
+ *       = 6 (secant[i] - secant[i-1]),
+ * as a tridiagonal one corrected by the Sherman-Morrison
+ * formula, and store the coefficients of each segment.
+ */
+void BoundaryCondition::findPeriodicSpline(int column)
+{
+    int n = times.size();
+    int offset = column * n;
+    const double *v = values.constData() + offset;
+    QVector<double> widths(n), secants(n);
+    for (int i = 0; i < n; i++) {
+        widths[i] = segmentWidth(i);
+        secants[i] = (v[(i + 1) % n] - v[i]) / widths[i];
+    }
+    QVector<double> lower(n), diagonal(n), upper(n), moments(n);
+    for (int i = 0; i < n; i++) {
+        int before = (i + n - 1) % n;
+        lower[i] = widths[before];
+        diagonal[i] = 2 * (widths[before] + widths[i]);
+        upper[i] = widths[i];
+        moments[i] = 6 * (secants[i] - secants[before]);
+    }
+
+    // both corners of the cyclic matrix are widths[n - 1]
+    double corner = widths[n - 1];
+    double gamma = -diagonal[0];
+    diagonal[0] -= gamma;
+    diagonal[n - 1] -= corner * corner / gamma;
+    QVector<double> z(n, 0);
+    z[0] = gamma;
+    z[n - 1] = corner;
+    solveTridiagonal(lower, diagonal, upper, moments);
+    solveTridiagonal(lower, diagonal, upper, z);
+    double factor = (moments[0] + corner * moments[n - 1] / gamma)
+            / (1 + z[0] + corner * z[n - 1] / gamma);
+    for (int i = 0; i < n; i++)
+        moments[i] -= factor * z[i];
+
+    for (int i = 0; i < n; i++) {
+        int j = (i + 1) % n;
+        firstOrder[offset + i] = secants[i] - widths[i] * (2 * moments[i] + moments[j]) / 6;
+        secondOrder[offset + i] = moments[i] / 2;
+        thirdOrder[offset + i] = (moments[j] - moments[i]) / (6 * widths[i]);
+    }
+}
+
+/* Private Function: solveTridiagonal(const QVector<double> &,
+ * const QVector<double> &, const QVector<double> &, QVector<double> &)
+ * --------------------------------------------------------------------
+ * Solve the tridiagonal system with the given diagonals
+ * in place of x, which holds the right hand side.
+ */
+void BoundaryCondition::solveTridiagonal(const QVector<double> &lower,
+                                         const QVector<double> &diagonal,
+                                         const QVector<double> &upper,
+                                         QVector<double> &x)
+{
+    int n = x.size();
+    QVector<double> scaled(n);
+    double pivot = diagonal[0];
+    x[0] /= pivot;
+    for (int i = 1; i < n; i++) {
+        scaled[i] = upper[i - 1] / pivot;
+        pivot = diagonal[i] - lower[i] * scaled[i];
+        x[i] = (x[i] - lower[i] * x[i - 1]) / pivot;
+    }
+    for (int i = n - 1; i > 0; i--)
+        x[i - 1] -= scaled[i] * x[i];
 }
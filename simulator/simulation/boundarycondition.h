@@ -14,10 +14,56 @@
  * and allows the user to get the value at the given boundary at any given
  * time.
  *
- * The value is linearly interpolated between points in the given file.
+ * The value is linearly interpolated between points in the given file, or
+ * with cubic segments chosen with setInterpolation(): monotone cubic Hermite
+ * (Fritsch-Carlson), which has a continuous slope and never overshoots the
+ * values of the file, or a periodic cubic spline, which also has a
+ * continuous second derivative. The coefficients of the cubic segments are
+ * computed once, and ngspice is not made to stop on their points.
+ * The points are kept in sorted arrays, and getState() keeps a cursor at the
+ * last time asked for, so the increasing times of a transient run cost
+ * amortized O(1) each; a jump back (a rejected step) or far ahead falls back
+ * to a binary search. The cursor assumes a single caller, the SpiceEngine.
+ * If the points are evenly spaced, as sampled pressure files are, getState()
+ * finds the segment by index arithmetic without any search.
+ *
+ * Points where the slope of the interpolated value changes sharply, such as
+ * a valve closing, can be given to ngspice as breakpoints with breakpoints().
+ *
+ * A file whose first line is "fourier <period>" holds a truncated Fourier
+ * series instead, one harmonic per line as <k> <a_k> <b_k>, for the value
+ * a_0 + sum of a_k cos(2 pi k t / period) + b_k sin(2 pi k t / period).
+ * It is summed with the angle addition formulas, so only one cos and one sin
+ * are computed per call, and has no points or breakpoints.
+ *
+ * A table may also hold several value columns sharing its time column, named
+ * in a header line such as "time V1 V2 V3", so that one file gives the inputs
+ * of many external elements. The same BoundaryCondition is then shared by
+ * the elements, each reading the column of its name with columnOf(); an
+ * element with no column of its name in such a table is an error. The
+ * values are kept column by column, and getState() interpolates all of them
+ * the first time it is asked for a new time, so the other elements asking
+ * for the same time read the stored result.
+ *
+ * For runs with a fixed time step, resample() stores the value of every
+ * column at each multiple of the step in one period, and getState() then
+ * reads a time on that grid with a single indexed load. Other times, such as
+ * the steps ngspice cuts short, are interpolated as before.
+ *
+ * Files are parsed once per process: the tables read are kept in a cache
+ * keyed by the path, modification time and size of a file and a hash of its
+ * contents, and their vectors are implicitly shared by every
+ * BoundaryCondition made from the same contents. setCacheCapacity() limits
+ * how many tables are kept, and cacheHitCount() and cacheMissCount() count
+ * the files found in the cache and parsed.
  *
  * The static funciton checkFile(QString filename) allows other classes to check
  * if a file is properly formatted to be used as a BoundaryCondition file.
+ * load() reads a file and checks it in one pass, and may be run on a worker
+ * thread (e.g. with QtConcurrent::run) so that files are read in parallel
+ * without blocking the GUI; a file that cannot be read gives a condition
+ * that is not isValid(), with the line at fault in errorString().
+ * Files may also be binary tables written by the noGUI bcconvert tool.
  */
 class BoundaryCondition : public QObject
 {
@@ -25,16 +71,134 @@ class BoundaryCondition : public QObject
 public:
     explicit BoundaryCondition(QString filename,
                                QObject *parent = nullptr);
-    double getState(double time);
-    static bool checkFile(QString filename);
+    static BoundaryCondition *load(QString filename);
+    bool isValid() { return loadError.isEmpty(); }
+    QString errorString() { return loadError; }
+    QStringList columnNames() { return names; }
+    bool fileChanged();
+    double getState(double time, int column = 0);
+    int columnCount() { return valueColumns; }
+    int columnOf(QString name);
+    static int findColumn(const QStringList &columns, QString name);
+    static QStringList tableColumns(QString filename);
+    static void setCacheCapacity(int capacity);
+    static int cacheHitCount();
+    static int cacheMissCount();
+    double nextKnot(double time);
+    double getPeriod() { return period; }
+    QList<double> breakpoints(double threshold);
+    static constexpr double defaultBreakpointThreshold = 0.5;
+    static bool checkFile(QString filename, QString *error = nullptr);
+    bool isFourier() { return !cosines.isEmpty(); }
+    enum Interpolation { Linear, MonotoneCubic, PeriodicSpline };
+    void setInterpolation(Interpolation mode);
+    Interpolation getInterpolation() { return interpolation; }
+    void resample(double step);
+    static const int maxResampledValues = 1 << 24;
 
 private:
-    QMap<qreal, qreal> states;
+    // reading files: text tables are parsed in place from a memory
+    // map, binary tables copied from it
+    static bool readTable(QString filename, QByteArray &header,
+                          QVector<QVector<double>> &columns, QString &error);
+    static bool parseText(const char *begin, const char *end, QByteArray &header,
+                          QVector<QVector<double>> &columns, QString &error);
+    static bool parseLine(const char *p, const char *end, QByteArray &header,
+                          QVector<QVector<double>> &columns, QString &error);
+    static bool parseBinary(const char *begin, const char *end, QByteArray &header,
+                            QVector<QVector<double>> &columns, QString &error);
+    static bool checkTable(const QByteArray &header,
+                           const QVector<QVector<double>> &columns, QString &error);
+    // tables already read: the sorted contents of a file by its hash and
+    // size, and the state of each path when it was last hashed
+    struct Table {
+        QVector<double> times;
+        QVector<double> values;
+        QStringList names;
+        double period = 0;
+        QVector<double> cosines;
+        QVector<double> sines;
+        quint64 lastUsed = 0;
+    };
+    struct FileState {
+        QDateTime modified;
+        qint64 size = 0;
+        quint64 hash = 0;
+    };
+    static QMutex cacheMutex;
+    static QHash<QString, FileState> cachedFiles;
+    static QMap<QPair<quint64, qint64>, Table> cachedTables;
+    static int cacheCapacity;
+    static int cacheHits;
+    static int cacheMisses;
+    static quint64 cacheClock;
+    static bool loadTable(QString filename, Table &table, QString &error);
+    static void buildTable(const QByteArray &header,
+                           const QVector<QVector<double>> &columns, Table &table);
+    static bool hashFile(QString filename, FileState &state);
+    static void evictTables();
+    // points sorted by time; a repeated time keeps its last value.
+    // Value column c is values[c * n] to values[c * n + n - 1]
+    QVector<double> times;
+    QVector<double> values;
+    int valueColumns = 1;
+    QStringList names;
     double period;
-    double interpolate(
-            QMap<qreal, qreal>::iterator low,
-            QMap<qreal, qreal>::iterator high,
-            double time);
+    QString loadError;
+    // the file read, and its modification time and size before reading
+    QString sourcePath;
+    QDateTime sourceModified;
+    qint64 sourceSize = -1;
+    // states of every column at the time last given to getState()
+    QVector<double> states;
+    double statesTime = qQNaN();
+    void findStates(double time);
+    // values of every column at the samplePoints multiples of 1 / sampleScale
+    // in one period, one time after another, if resampled; current points
+    // at the values at statesTime, in states or samples
+    QVector<double> samples;
+    double sampleScale = 0;
+    int samplePoints = 0;
+    const double *current = nullptr;
+    const double *sampleAt(double time);
+    // Fourier coefficients a_k and b_k, k = 0..K, or empty for a table
+    QVector<double> cosines;
+    QVector<double> sines;
+    double fourierState(double time);
+    // spacing of the points and its inverse if they are evenly spaced, else 0
+    double gridStep = 0;
+    double gridScale = 0;
+    void findGridStep();
+    // index of the first point after the time last given to getState()
+    int cursor = 0;
+    // points the cursor steps over before a binary search is used instead
+    static const int maxCursorSteps = 8;
+    // time in the period and relative change of slope at each point
+    QList<QPair<double, double>> slopeChanges;
+    void findSlopeChanges();
+    // cubic segment i is values[i] + h * (firstOrder[i] + h * (secondOrder[i]
+    // + h * thirdOrder[i])), h the time from times[i]; segment n - 1 wraps.
+    // The coefficients are kept column by column, as the values are
+    Interpolation interpolation = Linear;
+    QVector<double> firstOrder;
+    QVector<double> secondOrder;
+    QVector<double> thirdOrder;
+    double segmentWidth(int i);
+    void setHermiteCoefficients(int column, const QVector<double> &slopes);
+    void findMonotoneCubic(int column);
+    void findPeriodicSpline(int column);
+    static void solveTridiagonal(const QVector<double> &lower, const QVector<double> &diagonal,
+                                 const QVector<double> &upper, QVector<double> &x);
+    // where a time falls: on the segment from point i to point j, h after
+    // point i and fraction of the way to j; a time held at a point has
+    // j = i and h = fraction = 0
+    struct Position {
+        int i;
+        int j;
+        double h;
+        double fraction;
+    };
+    Position positionBelow(int upper, double time);
 
 
 signals:
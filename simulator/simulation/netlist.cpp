@@ -29,8 +29,9 @@ int Netlist::addElement(CircuitElement *element, int nodeIn, int nodeOut)
             QString::number(nodeOut);
     if (element->getExternalFile() != "") {
         line += " external";
-        BoundaryCondition *bc = new BoundaryCondition(element->getExternalFile(),
-                                                      this);
+        BoundaryCondition *&bc = conditionFiles[element->getExternalFile()];
+        if (!bc) bc = new BoundaryCondition(element->getExternalFile(), this);
+        if (bc->columnOf(element->getName()) < 0) return NoColumnError;
         boundaryConditions[element->getName().toLower()] = bc;
     } else {
         line += (" " + element->getValue());
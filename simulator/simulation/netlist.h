@@ -63,8 +63,11 @@ public:
      * NoNameError: An element was found that did not have a name
      * DuplicateNameError: An element was found that had the same name as an
      *                     element already added to the netlist.
+     * NoColumnError: An external element was given a table with several
+     *                value columns, none of them named after it.
      */
-    enum { NoValueError = 3, NoNameError = 4, DuplicateNameError = 5 };
+    enum { NoValueError = 3, NoNameError = 4, DuplicateNameError = 5,
+           NoColumnError = 6 };
 
     // Editing functions
     int addElement(CircuitElement *element, int nodeIn, int nodeOut);
@@ -89,7 +92,8 @@ public:
     QMap<QString, BoundaryCondition *> boundaryConditions;
     double getBoundaryValue(char *node, double time)
     {
-        return boundaryConditions[node]->getState(time);
+        BoundaryCondition *bc = boundaryConditions[node];
+        return bc->getState(time, bc->columnOf(node));
     }
     const QMap<QString, BoundaryCondition *> *getBoundaryConditions()
     {
@@ -107,6 +111,8 @@ private:
     QString analysis;
     QString filename;
     QString graphingCommand;
+    // one BoundaryCondition per file, read by every element given it
+    QMap<QString, BoundaryCondition *> conditionFiles;
 };
 
 #endif // NETLIST_H
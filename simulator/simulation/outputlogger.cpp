@@ -0,0 +1,140 @@
+#include <zlib.h>
+#include "outputlogger.h"
+
+/* Constructor: OutputLogger(QObject *)
+ * ------------------------------------
+ * The ring is allocated once, so log() never
+ * has to grow it.
+ */
+OutputLogger::OutputLogger(QObject *parent) : QThread(parent)
+{
+    ring.resize(ringSize);
+}
+
+/* Destructor: ~OutputLogger()
+ * ---------------------------
+ * Write out any remaining lines and close the file.
+ */
+OutputLogger::~OutputLogger()
+{
+    close();
+}
+
+// ================= PUBLIC FUNCTIONS ==========================================
+
+/* Public Function: open(QString)
+ * ------------------------------
+ * Close any file being written, and start appending
+ * lines to the file named filename, gzip compressed if
+ * it ends in .gz. Resets the counters.
+ * Returns false if the file could not be opened.
+ */
+bool OutputLogger::open(QString filename)
+{
+    close();
+    this->filename = filename;
+    compress = filename.endsWith(".gz", Qt::CaseInsensitive);
+    if (compress) {
+        gzfile = gzopen(QFile::encodeName(filename).constData(), "ab");
+        if (gzfile == nullptr) return false;
+    } else {
+        file.setFileName(filename);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+            return false;
+    }
+
+    head.store(0);
+    tail.store(0);
+    stopping.store(0);
+    droppedCount.store(0);
+    writtenCount.store(0);
+    start(QThread::LowPriority);
+    return true;
+}
+
+/* Public Function: close()
+ * ------------------------
+ * Stop the writer thread once it has written every
+ * line logged so far, and close the file.
+ */
+void OutputLogger::close()
+{
+    if (isRunning()) {
+        stopping.storeRelease(1);
+        wait();
+    }
+    if (gzfile != nullptr) {
+        gzclose(static_cast<gzFile>(gzfile));
+        gzfile = nullptr;
+    }
+    if (file.isOpen()) file.close();
+}
+
+/* Public Function: log(const char *)
+ * ----------------------------------
+ * Queue line to be written, followed by a newline.
+ * Must only be called from one thread at a time.
+ * Never blocks: if the writer has fallen too far
+ * behind, the line is dropped.
+ */
+void OutputLogger::log(const char *line)
+{
+    int t = tail.load();
+    int next = (t + 1) & (ringSize - 1);
+    if (next == head.loadAcquire()) {
+        droppedCount.ref();
+        return;
+    }
+    ring[t] = QByteArray(line);
+    tail.storeRelease(next);
+}
+
+// ================= PROTECTED FUNCTIONS =======================================
+
+/* Protected Function: run()
+ * -------------------------
+ * Writer thread: move lines from the ring into a
+ * batch, and write the batch when it is large or
+ * the ring is empty. Sleeps briefly when idle, so
+ * log() never has to wake it.
+ */
+void OutputLogger::run()
+{
+    QByteArray batch;
+    batch.reserve(batchBytes + 1024);
+    forever {
+        bool stop = stopping.loadAcquire();
+        int h = head.load();
+        int t = tail.loadAcquire();
+        while (h != t) {
+            batch.append(ring[h]);
+            batch.append('\n');
+            ring[h].clear();
+            h = (h + 1) & (ringSize - 1);
+            head.storeRelease(h);
+            writtenCount.ref();
+            if (batch.size() >= batchBytes) writeBatch(batch);
+        }
+        if (!batch.isEmpty()) writeBatch(batch);
+        if (stop) break;
+        msleep(5);
+    }
+}
+
+// ================= PRIVATE FUNCTIONS =========================================
+
+/* Private Function: writeBatch(QByteArray &)
+ * ------------------------------------------
+ * Write batch to the file in one call, and empty it.
+ */
+void OutputLogger::writeBatch(QByteArray &batch)
+{
+    if (compress) {
+        gzwrite(static_cast<gzFile>(gzfile), batch.constData(),
+                static_cast<unsigned>(batch.size()));
+    } else {
+        file.write(batch);
+        file.flush();
+    }
+    batch.resize(0);
+}
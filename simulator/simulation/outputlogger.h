@@ -0,0 +1,64 @@
+#ifndef OUTPUTLOGGER_H
+#define OUTPUTLOGGER_H
+
+#include <QtCore>
+
+/* CLASS: OutputLogger
+ * ===================
+ * Inherits: QThread
+ * Parent: SpiceEngine
+ *
+ * An OutputLogger writes lines of ngspice output to a file without slowing
+ * down the thread that produces them.
+ *
+ * log() is called from a single thread (the ngspice background thread) and
+ * only copies the line into a fixed size lock-free ring. The logger's own
+ * thread takes lines off the ring and writes them to the file in large
+ * batches. If the ring is full the line is dropped rather than making the
+ * simulation wait, and counted in dropped().
+ *
+ * Files ending in .gz are written gzip compressed.
+ */
+class OutputLogger : public QThread
+{
+    Q_OBJECT
+public:
+    explicit OutputLogger(QObject *parent = nullptr);
+    ~OutputLogger();
+    bool open(QString filename);
+    void close();
+    void log(const char *line);
+    // Lines given to log() that did not fit in the ring
+    int dropped() { return droppedCount.load(); }
+    // Lines waiting in the ring to be written
+    int backlog() { return (tail.loadAcquire() - head.loadAcquire()) & (ringSize - 1); }
+    // Lines written to the file since it was opened
+    int written() { return writtenCount.load(); }
+
+protected:
+    void run() override;
+
+private:
+    // must be a power of two
+    static const int ringSize = 1 << 14;
+    // write once this many bytes are batched up
+    static const int batchBytes = 1 << 16;
+
+    // ring of lines: slots [head, tail) are filled by log() and
+    // emptied by run(); one slot is always left free
+    QVector<QByteArray> ring;
+    QAtomicInt head;
+    QAtomicInt tail;
+    QAtomicInt stopping;
+
+    QAtomicInt droppedCount;
+    QAtomicInt writtenCount;
+
+    QString filename;
+    bool compress = false;
+    QFile file;
+    void *gzfile = nullptr;
+    void writeBatch(QByteArray &batch);
+};
+
+#endif // OUTPUTLOGGER_H
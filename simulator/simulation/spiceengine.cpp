@@ -1,5 +1,11 @@
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
 #include "spiceengine.h"
 
+constexpr double SpiceEngine::defaultForegroundCost;
+constexpr double SpiceEngine::minKnotStep;
+
 /* Constructor: SpiceEngine(QObject *)
  * -----------------------------------
  * Loads ngspice library
@@ -7,6 +13,7 @@
 SpiceEngine::SpiceEngine(QObject *parent) : QObject(parent)
 {
     lngspice = new QLibrary("ngspice", this);
+    logger = new OutputLogger(this);
 }
 
 /* Destructor: ~SpiceEngine()
@@ -23,7 +30,8 @@ SpiceEngine::~SpiceEngine()
 /* Public Function: init()
  * -----------------------
  * Resolves relevant ngspice functions: ngSpice_Init, ngSpice_Init_Sync,
- * ngSpice_Command, ngSpice_running and ngSpice_CurPlot
+ * ngSpice_Command, ngSpice_running and ngSpice_CurPlot, and ngSpice_SetBkpt
+ * if the library has it
  * Calls ngSpice_Init and ngSpiceInit_Sync to initialize the ngspice engine
  * with the callback functions
  *
@@ -42,10 +50,12 @@ void SpiceEngine::init()
         emit spiceError("Could not load Ngspice function");
         return;
     }
-    initSync(getvoltage, getcurrent, nullptr, nullptr, this);
+    initSync(getvoltage, getcurrent, getsync, nullptr, this);
     ngspice_command = (CommandFunction)lngspice->resolve("ngSpice_Command");
     ngspice_running = (RunningFunction)lngspice->resolve("ngSpice_running");
     ngspice_curPlot = (CurPlotFunction)lngspice->resolve("ngSpice_CurPlot");
+    // optional: without it, simulations run without breakpoints
+    ngspice_setBkpt = (SetBkptFunction)lngspice->resolve("ngSpice_SetBkpt");
     if (!ngspice_command || !ngspice_running || !ngspice_curPlot)
         emit spiceError("Could not load Ngspice function");
 }
@@ -63,7 +73,7 @@ bool SpiceEngine::getErrorStatus(QString &message)
 /* Public Function: startSimulation(QString,
  *      const QMap<QString, BoundaryCondition *>, bool, QString)
  * -------------------------------------------------------------
- * Start running an ngspice background simulation with the script
+ * Start running an ngspice simulation with the script
  * given by filename and the boundary conditions as in bcs.
  * Dump indicates whether the output of the simulator should be
  * written to the dumpFilename.
@@ -72,28 +82,24 @@ int SpiceEngine::startSimulation(QString filename,
                                   const QMap<QString, BoundaryCondition *> *bcs,
                                   bool dump, QString dumpFilename)
 {
+    this->filename = filename;
     this->dump = dump;
     this->dumpFilename = dumpFilename;
+    openDump();
     this->bcs = bcs;
+    this->netlist = nullptr;
+    resetProgress();
+    resetExternalSources();
     int ret = command("source " + filename);
     if (ret != 0) {
         setErrorFlag("NGSPICE: Error loading circuit file");
         return ret;
     }
-    pthread_mutex_lock(&mutex);
-    ret = run();
-    if (ret != 0) {
-        setErrorFlag("NGSPICE: Error running simulation");
-        pthread_mutex_unlock(&mutex);
-        return ret;
-    }
-    // wait for background thread to start
-    while(no_bg) {
-        pthread_cond_wait(&cond, &mutex);
-    }
-    pthread_mutex_unlock(&mutex);
-
-    return 0;
+    applyInterpolation();
+    applyResampling(filename);
+    resetBreakpoints();
+    applySavedVectors(filename);
+    return startRun(filename);
 }
 
 /* Public Function: startSimulation(Netlist *, bool, QString)
@@ -106,29 +112,64 @@ int SpiceEngine::startSimulation(Netlist *netlist, bool dump, QString dumpFilena
 {
     this->dump = dump;
     this->dumpFilename = dumpFilename;
+    openDump();
     filename = netlist->getFilename();
     this->netlist = netlist;
+    resetProgress();
+    resetExternalSources();
     int ret = command("source " + filename);
     if (ret != 0) {
         setErrorFlag("NGSPICE: Error loading circuit file");
         return ret;
     }
-    pthread_mutex_lock(&mutex);
-    ret = run();
-    if (ret != 0) {
-        setErrorFlag("NGSPICE: Error running simulation");
-        pthread_mutex_unlock(&mutex);
-        return ret;
-    }
-    // wait for background thread to start
-    while(no_bg) {
-        pthread_cond_wait(&cond, &mutex);
-    }
-    pthread_mutex_unlock(&mutex);
+    applyInterpolation();
+    applyResampling(filename);
+    resetBreakpoints();
+    applySavedVectors(filename);
+    return startRun(filename);
+}
 
+/* Public Function: alterParameters(QMap<QString, QString>)
+ * --------------------------------------------------------
+ * Change element values or parameters of the loaded circuit
+ * in place, without parsing it again. Keys are of the form
+ * <element>, <element>.<parameter>, or model:<model>.<parameter>
+ * for the ngspice commands alter and altermod. Changes take
+ * effect when the simulation is run again.
+ */
+int SpiceEngine::alterParameters(QMap<QString, QString> values)
+{
+    QMap<QString, QString>::iterator it;
+    for (it = values.begin(); it != values.end(); ++it) {
+        QString target = it.key();
+        QString command = "alter ";
+        if (target.startsWith("model:")) {
+            target = target.mid(6);
+            command = "altermod ";
+        }
+        command += target.replace('.', ' ') + " = " + it.value();
+        int ret = this->command(command);
+        if (ret != 0) {
+            setErrorFlag("NGSPICE: Error changing " + it.key());
+            return ret;
+        }
+    }
     return 0;
 }
 
+/* Public Function: rerunSimulation()
+ * ----------------------------------
+ * Run the loaded circuit again from the start, with
+ * any changes made by alterParameters(), without
+ * loading the circuit file again.
+ */
+int SpiceEngine::rerunSimulation()
+{
+    resetProgress();
+    resetBreakpoints();
+    return startRun(filename);
+}
+
 /* Public Function: resumeSimulation()
  * -----------------------------------
  * Resume simulation in background.
@@ -240,25 +281,41 @@ QList<QString> SpiceEngine::vectors()
     return vectorNames;
 }
 
+/* Public Function: getSaveInfo()
+ * ------------------------------
+ * Returns a line comparing the number of vectors kept
+ * by ngspice with the number it would keep without a
+ * save command, or an empty string if all were kept.
+ */
+QString SpiceEngine::getSaveInfo()
+{
+    if (savedVectors.isEmpty()) return "";
+    int all = qMax(estimatedVectors, numVectors);
+    if (all == 0) return "";
+    int reduction = qRound(100.0 * (all - numVectors) / all);
+    return QString("Kept %1 of about %2 vectors (%3% less memory)")
+            .arg(numVectors).arg(all).arg(reduction);
+}
+
 // ========= PUBLIC FUNCTIONS FOR USE IN CALLBACKS =============================
 
-/* Public Function (ngspice only): _emitStatusUpdate(char *)
- * ---------------------------------------------------------
- * Emit a status update with the status of the simulation
- * if the update is a numeric % update.
+/* Public Function (ngspice only): _setStatus(char *)
+ * --------------------------------------------------
+ * Store the percentage of the simulation done if the
+ * status is a numeric % update, such as "tran 42.1%".
+ * Only an atomic is written; the page showing progress
+ * samples it with progress() on a timer.
  * This function is called by the ngspice callback SendStat only.
  */
-void SpiceEngine::_emitStatusUpdate(char *status)
+void SpiceEngine::_setStatus(char *status)
 {
-    QString line = QString(status);
-    QStringList tokens = line.split(" ");
-    if (tokens.length() < 2) {
-        if (tokens[0] == "--ready--")
-            emit statusUpdate(100);
+    const char *space = strchr(status, ' ');
+    if (space == nullptr) {
+        if (strcmp(status, "--ready--") == 0) percentDone.store(100);
         return;
     }
-    qreal stat = tokens[1].left(tokens[1].length() - 1).toDouble();
-    if (stat != 0.0) emit statusUpdate(static_cast<int>(stat));
+    double stat = strtod(space + 1, nullptr);
+    if (stat != 0.0) percentDone.store(static_cast<int>(stat));
 }
 
 /* Public Function (ngspice only): _writeOutput(char *)
@@ -268,35 +325,65 @@ void SpiceEngine::_emitStatusUpdate(char *status)
  * If the output is an error message (prefix stderr Error:)
  * then send a spiceError() signal.
  *
- * If dumping to file, write output to file.
+ * If dumping to file, queue output for the logger
+ * thread to write.
  */
 void SpiceEngine::_writeOutput(char *output)
 {
-    if (QString(output).startsWith("stderr Error:", Qt::CaseInsensitive))
+    if (qstrnicmp(output, "stderr Error:", 13) == 0)
         emit spiceError(QString(output));
-    if (!dump) return;
-    QFile file(dumpFilename);
-    if (file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
-        QTextStream out(&file);
-        out << output << endl;
-        file.close();
-    }
+    if (dump) logger->log(output);
 }
 
 /* Public Function (ngspice only): _getBoundaryCondition(double *, double, char *)
  * ---------------------------------------------------------------------
  * Get boundary condition at given node and time from bcs or netlist and
- * set value of double at given address to this voltage.
+ * set value of double at given address to this voltage. Nodes given a
+ * table of several value columns read the column of their name. The
+ * node is found by the address of its name (see resolveExternal()).
  *
  * Called by ngspice callbacks GetVSRCData and GetISRCData
  */
 void SpiceEngine::_getBoundaryCondition(double *value, double t, char *node)
 {
-    if (netlist == nullptr) {
-        *value = bcs->value(node)->getState(t);
-    } else {
-        *value = netlist->getBoundaryValue(node, t);
-    }
+    const ExternalSource *source = resolveExternal(node);
+    *value = source->bc ? source->bc->getState(t, source->column) : 0;
+}
+
+/* Public Function (ngspice only): _syncTimeStep(double, double *, int, int)
+ * -------------------------------------------------------------------------
+ * Count time steps and rejected steps, and shorten the step ngspice is about
+ * to try so that it ends on the next point given in any boundary condition
+ * file. Linear interpolation has a kink at each of these points, and a step
+ * across one is likely to be rejected. A point less than minKnotStep of the
+ * step ahead is stepped over rather than ended on, since a sliver step makes
+ * ngspice take several more to grow the step back; the step then ends on
+ * the next point within it, or runs on whole.
+ *
+ * Called by ngspice callback GetSyncData, before each new time step
+ * (location 0) and after deciding whether to redo a step (location 1).
+ */
+void SpiceEngine::_syncTimeStep(double time, double *delta, int redostep, int location)
+{
+    if (redostep) rejectedStepCount.ref();
+    if (location != 0) return;
+
+    stepCount.ref();
+    simTime.store(time, std::memory_order_relaxed);
+    if (time + breakpointWindow >= breakpointWindows * breakpointWindow)
+        addBreakpointWindow();
+    const QMap<QString, BoundaryCondition *> *conditions = activeBoundaryConditions();
+    if (conditions == nullptr) return;
+    double end = time + *delta;
+    double knot = time;
+    do {
+        double after = knot;
+        knot = qInf();
+        foreach(BoundaryCondition *bc, *conditions) {
+            knot = qMin(knot, bc->nextKnot(after));
+        }
+    } while (knot < end && knot - time < minKnotStep * *delta);
+    if (end > knot) *delta = knot - time;
 }
 
 /* Public Function (ngspice only): _setVecInfo(pvecinfoall)
@@ -328,6 +415,378 @@ void SpiceEngine::_quit()
 
 // =============== PRIVATE FUNCTIONS ===========================================
 
+/* Private Function: openDump()
+ * -----------------------------
+ * Start the logger on dumpFilename if dumping,
+ * or stop it otherwise.
+ */
+void SpiceEngine::openDump()
+{
+    if (!dump) {
+        logger->close();
+        return;
+    }
+    if (!logger->open(dumpFilename)) {
+        setErrorFlag("Could not open " + dumpFilename + " to write output");
+        dump = false;
+    }
+}
+
+/* Private Function: startRun(QString)
+ * ------------------------------------
+ * Run the circuit loaded from filename. Short circuits
+ * (below foregroundCost) are run to the end on the calling
+ * thread, since starting the background thread and waiting
+ * for it takes longer than the simulation itself. Others
+ * are started in the background thread. A foreground run
+ * blocks the GUI until it ends, so foregroundCost is 0
+ * (never) unless set.
+ */
+int SpiceEngine::startRun(QString filename)
+{
+    double cost = estimateRunCost(filename);
+    if (cost <= 0 || cost >= foregroundCost) return startBackgroundRun();
+
+    int ret = runForeground();
+    if (ret != 0) {
+        setErrorFlag("NGSPICE: Error running simulation");
+        return ret;
+    }
+    percentDone.store(100);
+    return 0;
+}
+
+/* Private Function: startBackgroundRun()
+ * ---------------------------------------
+ * Run the loaded circuit in the ngspice background
+ * thread, and wait for the thread to start. A short
+ * run can start and stop before this thread wakes up,
+ * so wait for the start count to change rather than
+ * for no_bg to go false.
+ */
+int SpiceEngine::startBackgroundRun()
+{
+    pthread_mutex_lock(&mutex);
+    int starts = bgStarts;
+    int ret = run();
+    if (ret != 0) {
+        setErrorFlag("NGSPICE: Error running simulation");
+        pthread_mutex_unlock(&mutex);
+        return ret;
+    }
+    // wait for background thread to start
+    while(bgStarts == starts) {
+        pthread_cond_wait(&cond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return 0;
+}
+
+/* Private Function: resetProgress()
+ * ---------------------------------
+ * Zero the progress and step counters
+ * for a new run.
+ */
+void SpiceEngine::resetProgress()
+{
+    percentDone.store(0);
+    simTime.store(0.0);
+    stepCount.store(0);
+    rejectedStepCount.store(0);
+}
+
+/* Private Function: resetBreakpoints()
+ * -------------------------------------
+ * Register the breakpoints of the first two windows
+ * for a newly loaded circuit. Breakpoints set before
+ * the run are kept by ngspice until it starts.
+ */
+void SpiceEngine::resetBreakpoints()
+{
+    breakpointWindow = 0;
+    breakpointWindows = 0;
+    const QMap<QString, BoundaryCondition *> *conditions = activeBoundaryConditions();
+    if (conditions == nullptr) return;
+    foreach(BoundaryCondition *bc, *conditions) {
+        breakpointWindow = qMax(breakpointWindow, bc->getPeriod());
+    }
+    addBreakpointWindow();
+    addBreakpointWindow();
+}
+
+/* Private Function: addBreakpointWindow()
+ * ---------------------------------------
+ * Give ngspice a breakpoint at every point of the
+ * next window at which a boundary condition changes
+ * slope by at least breakpointThreshold.
+ */
+void SpiceEngine::addBreakpointWindow()
+{
+    const QMap<QString, BoundaryCondition *> *conditions = activeBoundaryConditions();
+    if (ngspice_setBkpt == nullptr || conditions == nullptr || breakpointWindow <= 0)
+        return;
+
+    double start = breakpointWindows * breakpointWindow;
+    breakpointWindows++;
+    double end = breakpointWindows * breakpointWindow;
+    QList<double> times;
+    foreach(BoundaryCondition *bc, *conditions) {
+        double period = bc->getPeriod();
+        QList<double> points = bc->breakpoints(breakpointThreshold);
+        if (period <= 0 || points.isEmpty()) continue;
+        for (double k = qFloor(start / period); k * period < end; k++) {
+            foreach(double t, points) {
+                double time = k * period + t;
+                if (time >= start && time < end) times.append(time);
+            }
+        }
+    }
+    std::sort(times.begin(), times.end());
+    foreach(double time, times) {
+        ngspice_setBkpt(time);
+    }
+}
+
+/* Private Function: applySavedVectors(QString)
+ * ---------------------------------------------
+ * Tell ngspice to keep only savedVectors (and the
+ * scale) for the circuit just loaded from filename,
+ * as a .save line in the file would. Estimates the
+ * number of vectors it would keep otherwise.
+ */
+void SpiceEngine::applySavedVectors(QString filename)
+{
+    estimatedVectors = 0;
+    if (savedVectors.isEmpty()) return;
+    command("save " + savedVectors.join(" "));
+    estimatedVectors = estimateVectorCount(filename);
+}
+
+/* Private Function: estimateVectorCount(QString)
+ * ----------------------------------------------
+ * Estimate the number of vectors ngspice keeps for
+ * the circuit in filename: the scale, one voltage per
+ * node, and one current per voltage source, inductor
+ * and voltage controlled element.
+ */
+int SpiceEngine::estimateVectorCount(QString filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return 0;
+
+    QSet<QString> nodes;
+    int branches = 0;
+    QTextStream in(&file);
+    in.readLine(); // title
+    while (!in.atEnd()) {
+        QStringList tokens = in.readLine().split(QRegExp("\\s+"), QString::SkipEmptyParts);
+        if (tokens.isEmpty() || QString("*.+").contains(tokens[0][0])) continue;
+
+        QChar type = tokens[0][0].toLower();
+        int terminals = 2;
+        if (type == 'e' || type == 'g' || type == 'm') terminals = 4;
+        else if (type == 'q' || type == 'j') terminals = 3;
+        if (type == 'v' || type == 'l' || type == 'e' || type == 'h') branches++;
+
+        for (int i = 1; i <= terminals && i < tokens.length(); i++) {
+            if (tokens[i] != "0" && tokens[i].toLower() != "gnd") nodes.insert(tokens[i]);
+        }
+    }
+    return 1 + nodes.size() + branches;
+}
+
+/* Private Function: estimateRunCost(QString)
+ * -------------------------------------------
+ * Estimate the cost of running the circuit in filename
+ * as the number of output points of its .tran line times
+ * the number of vectors. Returns 0 if there is no .tran line.
+ */
+double SpiceEngine::estimateRunCost(QString filename)
+{
+    double step, stop;
+    if (!readTransient(filename, step, stop) || step <= 0 || stop <= 0) return 0;
+    return (stop / step + 1) * estimateVectorCount(filename);
+}
+
+/* Private Function: readTransient(QString, double &, double &)
+ * -------------------------------------------------------------
+ * Read the step and stop time of the .tran line of the
+ * circuit in filename. Returns false if there is none.
+ */
+bool SpiceEngine::readTransient(QString filename, double &step, double &stop)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QStringList tokens = in.readLine().split(QRegExp("\\s+"), QString::SkipEmptyParts);
+        if (tokens.length() < 3 || tokens[0].toLower() != ".tran") continue;
+        step = parseValue(tokens[1]);
+        stop = parseValue(tokens[2]);
+        return true;
+    }
+    return false;
+}
+
+/* Private Function: parseValue(QString)
+ * -------------------------------------
+ * Parse a number with an optional SPICE scale factor,
+ * such as 10u or 1.5meg. Units after it are ignored.
+ */
+double SpiceEngine::parseValue(QString value)
+{
+    QRegExp number("^[-+]?(\\d+\\.?\\d*|\\.\\d+)([eE][-+]?\\d+)?");
+    if (number.indexIn(value) != 0) return 0;
+    double result = number.cap(0).toDouble();
+    QString suffix = value.mid(number.matchedLength()).toLower();
+    if (suffix.startsWith("meg")) return result * 1e6;
+    if (suffix.startsWith("mil")) return result * 25.4e-6;
+    switch (suffix.isEmpty() ? ' ' : suffix[0].toLatin1()) {
+    case 't': return result * 1e12;
+    case 'g': return result * 1e9;
+    case 'k': return result * 1e3;
+    case 'm': return result * 1e-3;
+    case 'u': return result * 1e-6;
+    case 'n': return result * 1e-9;
+    case 'p': return result * 1e-12;
+    case 'f': return result * 1e-15;
+    default: return result;
+    }
+}
+
+/* Private Function: activeBoundaryConditions()
+ * --------------------------------------------
+ * Return the boundary conditions of the current
+ * simulation, from the netlist if there is one.
+ */
+const QMap<QString, BoundaryCondition *> *SpiceEngine::activeBoundaryConditions()
+{
+    if (netlist != nullptr) return netlist->getBoundaryConditions();
+    return bcs;
+}
+
+/* Private Function: resetExternalSources()
+ * ----------------------------------------
+ * Forget the external sources resolved for the last
+ * circuit. ngspice passes the names of its copy of a
+ * circuit, which change when a circuit is loaded.
+ */
+void SpiceEngine::resetExternalSources()
+{
+    externalSources.fill(ExternalSource(), 16);
+    externalCount = 0;
+}
+
+/* Private Function: resolveExternal(char *)
+ * -----------------------------------------
+ * Return the boundary condition and column of the
+ * node named by the given name from ngspice. The name
+ * stays at the same address while the circuit is
+ * loaded, so each is looked up in the boundary
+ * condition map once, and found afterwards by its
+ * address in a small open-addressing hash table,
+ * without building a QString. A node with no boundary
+ * condition is given a null one.
+ */
+const SpiceEngine::ExternalSource *SpiceEngine::resolveExternal(char *node)
+{
+    if (externalSources.isEmpty()) resetExternalSources();
+    const ExternalSource *sources = externalSources.constData();
+    int mask = externalSources.size() - 1;
+    for (int i = externalHash(node) & mask; sources[i].name; i = (i + 1) & mask) {
+        if (sources[i].name == node) return &sources[i];
+    }
+
+    if (2 * (externalCount + 1) > externalSources.size()) {
+        QVector<ExternalSource> old = externalSources;
+        externalSources.fill(ExternalSource(), 2 * old.size());
+        externalCount = 0;
+        foreach (const ExternalSource &source, old) {
+            if (source.name) insertExternal(source);
+        }
+    }
+    ExternalSource source;
+    source.name = node;
+    const QMap<QString, BoundaryCondition *> *conditions = activeBoundaryConditions();
+    QString name = QString(node).toLower();
+    if (conditions != nullptr && conditions->contains(name)) {
+        source.bc = conditions->value(name);
+        source.column = source.bc->columnOf(name);
+        // checked when the netlist is built; never read the wrong column
+        if (source.column < 0) {
+            source.bc = nullptr;
+            source.column = 0;
+        }
+    }
+    return insertExternal(source);
+}
+
+/* Static method: externalHash(const char *)
+ * ------------------------------------------
+ * Fibonacci hash of the address of a name, whose low
+ * bits are always zero.
+ */
+int SpiceEngine::externalHash(const char *name)
+{
+    quint64 address = reinterpret_cast<quintptr>(name);
+    return static_cast<int>((address * Q_UINT64_C(0x9E3779B97F4A7C15)) >> 33);
+}
+
+/* Private Function: insertExternal(const ExternalSource &)
+ * --------------------------------------------------------
+ * Place source in the first free slot of the table
+ * from the hash of its address.
+ */
+const SpiceEngine::ExternalSource *SpiceEngine::insertExternal(const ExternalSource &source)
+{
+    int mask = externalSources.size() - 1;
+    int i = externalHash(source.name) & mask;
+    while (externalSources[i].name)
+        i = (i + 1) & mask;
+    externalSources[i] = source;
+    externalCount++;
+    return &externalSources[i];
+}
+
+/* Private Function: applyInterpolation()
+ * ---------------------------------------
+ * Set the interpolation of every boundary condition
+ * of the circuit before its breakpoints are found.
+ */
+void SpiceEngine::applyInterpolation()
+{
+    const QMap<QString, BoundaryCondition *> *conditions = activeBoundaryConditions();
+    if (conditions == nullptr) return;
+    foreach(BoundaryCondition *bc, *conditions) {
+        if (bc->getInterpolation() != interpolation) bc->setInterpolation(interpolation);
+    }
+}
+
+/* Private Function: applyResampling(QString)
+ * -------------------------------------------
+ * Resample every boundary condition of the circuit in
+ * filename onto the step of its .tran line if resampling
+ * is on, or drop any values resampled for an earlier
+ * run. Called after applyInterpolation(), as changing
+ * the interpolation drops them too.
+ */
+void SpiceEngine::applyResampling(QString filename)
+{
+    const QMap<QString, BoundaryCondition *> *conditions = activeBoundaryConditions();
+    if (conditions == nullptr) return;
+    double step = 0, stop;
+    if (resampling && !readTransient(filename, step, stop)) step = 0;
+    // elements reading columns of one table share its BoundaryCondition
+    QSet<BoundaryCondition *> done;
+    foreach(BoundaryCondition *bc, *conditions) {
+        if (done.contains(bc)) continue;
+        done.insert(bc);
+        bc->resample(step);
+    }
+}
+
 /* Private Function: setErrorFlag(QString)
  * ---------------------------------------
  * Set errorFlag to true and errorMsg to
@@ -384,7 +843,7 @@ int getstat(char* outputreturn, int ident, void* userdata)
 {
     Q_UNUSED(ident);
     SpiceEngine *engine = static_cast<SpiceEngine *>(userdata);
-    engine->_emitStatusUpdate(outputreturn);
+    engine->_setStatus(outputreturn);
     return 0;
 }
 
@@ -399,6 +858,7 @@ int thread_runs(bool noruns, int ident, void* userdata)
     SpiceEngine *engine = static_cast<SpiceEngine *>(userdata);
     pthread_mutex_lock(&engine->mutex);
     engine->no_bg = noruns;
+    if (!noruns) engine->bgStarts++;
     pthread_cond_signal(&engine->cond);
     pthread_mutex_unlock(&engine->mutex);
     return 0;
@@ -453,3 +913,19 @@ int getcurrent(double* current, double t, char* node, int ident, void* userdata)
     return 0;
 }
 
+/* Callback function: getsync (GetSyncData)
+ * ----------------------------------------
+ * Called by bg thread before each time step and
+ * after each accepted or rejected step.
+ * Calls engine function _syncTimeStep to count steps
+ * and align the step with boundary condition points.
+ */
+int getsync(double time, double *delta, double olddelta, int redostep, int ident,
+            int location, void *userdata)
+{
+    Q_UNUSED(olddelta);
+    Q_UNUSED(ident);
+    SpiceEngine *engine = static_cast<SpiceEngine *>(userdata);
+    engine->_syncTimeStep(time, delta, redostep, location);
+    return 0;
+}
@@ -2,11 +2,13 @@
 #define SPICEENGINE_H
 
 #include <stdio.h>
+#include <atomic>
 #include <QObject>
 #include <QtWidgets>
 #include "boundarycondition.h"
 #include "include/sharedspice.h"
 #include "netlist.h"
+#include "outputlogger.h"
 
 // Declaration of callbacks for ngspice
 int getchar(char *outputreturn, int ident, void *userdata);
@@ -17,6 +19,8 @@ int initdata(pvecinfoall intdata, int ident, void *userdata);
 int data(pvecvaluesall vdata, int numvecs, int ident, void *userdata);
 int getvoltage(double *voltage, double t, char *node, int ident, void *userdata);
 int getcurrent(double *current, double t, char *node, int ident, void *userdata);
+int getsync(double time, double *delta, double olddelta, int redostep, int ident,
+            int location, void *userdata);
 
 /* CLASS: SpiceEngine
  * ==================
@@ -40,19 +44,47 @@ public:
                          const QMap<QString, BoundaryCondition *> *bcs,
                          bool dump, QString dumpFilename);
     int startSimulation(Netlist *netlist, bool dump, QString dumpFilename);
-    void _emitStatusUpdate(char *status);
+    void _setStatus(char *status);
     void _writeOutput(char *output);
     void _getBoundaryCondition(double *value, double t, char *node);
+    void _syncTimeStep(double time, double *delta, int redostep, int location);
     void _quit();
     bool running() { return ngspice_running(); }
     int stopSimulation();
     int resumeSimulation();
+    int alterParameters(QMap<QString, QString> values);
+    int rerunSimulation();
     QString curPlot() { return QString(ngspice_curPlot()); }
     QList<QString> vectors();
     void _setVecInfo(pvecinfoall info);
     int saveResults(QList<QString> vecs, bool bin, QString filename);
     int plotResults(QList<QString> vecs, bool png, QString filename);
     bool getErrorStatus(QString &message);
+    // Progress of the current simulation: percent done, simulation time, time
+    // steps tried and how many were rejected. Written by the ngspice callbacks
+    // and safe to sample from any thread.
+    int progress() { return percentDone.load(); }
+    double simulationTime() { return simTime.load(std::memory_order_relaxed); }
+    int steps() { return stepCount.load(); }
+    int rejectedSteps() { return rejectedStepCount.load(); }
+    void setBreakpointThreshold(double threshold) { breakpointThreshold = threshold; }
+    // Interpolation of the boundary conditions of the next simulation
+    void setInterpolation(BoundaryCondition::Interpolation mode) { interpolation = mode; }
+    // Resample the boundary conditions of the next simulation onto the step
+    // of its .tran line (see BoundaryCondition::resample())
+    void setResampling(bool enabled) { resampling = enabled; }
+    // Circuits with an estimated cost (output points times vectors) below
+    // this are run on the calling thread instead of the background thread.
+    // That blocks the GUI (and pause and progress) for the whole run, so
+    // it is off (0) unless the user asks for it
+    static constexpr double defaultForegroundCost = 0;
+    void setForegroundCost(double cost) { foregroundCost = cost; }
+    // Vectors for ngspice to keep, or empty to keep all of them
+    void setSavedVectors(QStringList vectors) { savedVectors = vectors; }
+    QString getSaveInfo();
+    // Lines of output dropped and waiting to be written when dumping
+    int droppedOutputLines() { return logger->dropped(); }
+    int pendingOutputLines() { return logger->backlog(); }
 
     // getPlotInfo() returns a string that can be used by the
     // wizard page to display information about the current plot.
@@ -64,10 +96,11 @@ public:
                 "Date: " + plotDate + "\n" +
                 "Plot: " + plotType; }
     bool no_bg = true; // used to determine if the background thread is running
+    int bgStarts = 0; // number of times the background thread has started
     bool errorflag = false;
     // The mutex and condition variable are used to protect
-    // no_bg and wait for it to change without blocking the
-    // main thread.
+    // no_bg and bgStarts and wait for them to change without
+    // blocking the main thread.
     pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
     pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
 
@@ -82,10 +115,12 @@ private:
     typedef int (*CommandFunction)(char*);
     typedef bool (*RunningFunction)(void);
     typedef char *(*CurPlotFunction)(void);
+    typedef bool (*SetBkptFunction)(double);
     // Handles for ngspice functions
     CommandFunction ngspice_command;
     RunningFunction ngspice_running;
     CurPlotFunction ngspice_curPlot;
+    SetBkptFunction ngspice_setBkpt = nullptr;
 
     // convenience wrappers around ngspice functions
     int command(QString command)
@@ -93,6 +128,7 @@ private:
         return ngspice_command(const_cast<char *>(command.toLatin1().data()));
     }
     int run() { return ngspice_command(const_cast<char *>("bg_run")); }
+    int runForeground() { return ngspice_command(const_cast<char *>("run")); }
     int halt() { return ngspice_command(const_cast<char *>("bg_halt")); }
     int resume() { return ngspice_command(const_cast<char *>("bg_resume")); }
 
@@ -101,7 +137,56 @@ private:
     QString filename;
     bool dump = false;
     QString dumpFilename;
+    OutputLogger *logger;
+    void openDump();
     Netlist *netlist = nullptr;
+    const QMap<QString, BoundaryCondition *> *activeBoundaryConditions();
+    BoundaryCondition::Interpolation interpolation = BoundaryCondition::Linear;
+    void applyInterpolation();
+    bool resampling = false;
+    void applyResampling(QString filename);
+    // external sources by the address of the name ngspice passes; the
+    // table is a power of two in size and at most half full
+    struct ExternalSource {
+        const char *name = nullptr;
+        BoundaryCondition *bc = nullptr;
+        int column = 0;
+    };
+    QVector<ExternalSource> externalSources;
+    int externalCount = 0;
+    void resetExternalSources();
+    const ExternalSource *resolveExternal(char *node);
+    const ExternalSource *insertExternal(const ExternalSource &source);
+    static int externalHash(const char *name);
+
+    // progress, written by the ngspice background thread
+    QAtomicInt percentDone;
+    std::atomic<double> simTime{0.0};
+    QAtomicInt stepCount;
+    QAtomicInt rejectedStepCount;
+    void resetProgress();
+
+    // breakpoints at sharp boundary condition changes, registered at least
+    // one window (the longest period) ahead of the simulation time
+    double breakpointThreshold = BoundaryCondition::defaultBreakpointThreshold;
+    // fraction of the step below which a file point just ahead is stepped over
+    static constexpr double minKnotStep = 0.1;
+    double breakpointWindow = 0;
+    int breakpointWindows = 0;
+    int startBackgroundRun();
+    int startRun(QString filename);
+    double foregroundCost = defaultForegroundCost;
+    static double estimateRunCost(QString filename);
+    static bool readTransient(QString filename, double &step, double &stop);
+    static double parseValue(QString value);
+    void resetBreakpoints();
+    void addBreakpointWindow();
+
+    // vectors kept with the ngspice save command
+    QStringList savedVectors;
+    int estimatedVectors = 0;
+    void applySavedVectors(QString filename);
+    static int estimateVectorCount(QString filename);
 
     // error handling
     void setErrorFlag(QString message);
@@ -117,7 +202,6 @@ private:
     QList<pvecinfo> vectorInfo;
 
 signals:
-    void statusUpdate(int status);
     void spiceError(QString errormsg);
     void initDataReady();
 
@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui multimedia network
+QT       += core gui multimedia network concurrent
 
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
@@ -34,6 +34,7 @@ SOURCES +=  \
     simulation/netlist.cpp \
     simulation/boundarycondition.cpp \
     simulation/spiceengine.cpp \
+    simulation/outputlogger.cpp \
     wizard/simulationwizard.cpp \
     wizard/savewizardpage.cpp \
     wizard/introwizardpage.cpp \
@@ -51,6 +52,7 @@ HEADERS += \
     simulation/netlist.h \
     simulation/boundarycondition.h \
     simulation/spiceengine.h \
+    simulation/outputlogger.h \
     wizard/simulationwizard.h \
     wizard/savewizardpage.h \
     wizard/introwizardpage.h \
@@ -60,6 +62,9 @@ HEADERS += \
     wizard/saveintrowizardpage.h \
     userpanel.h
 
+# gzip compression of the simulation output dump
+LIBS += -lz
+
 RESOURCES += \
     images.qrc
 
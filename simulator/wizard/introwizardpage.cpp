@@ -86,6 +86,14 @@ IntroWizardPage::IntroWizardPage(QMap<QString, BoundaryCondition *> *bcMap,
     registerField("completeCircuitFile", completeCircuit);
 }
 
+/* Destructor: conditions read but never given to the
+ * simulation are deleted, as are those still being read */
+IntroWizardPage::~IntroWizardPage()
+{
+    abandonLoading();
+    qDeleteAll(loaded);
+}
+
 // ============= PRIVATE FUNCTIONS =============================================
 
 /* Private Function: showExternalInputSelector()
@@ -128,6 +136,7 @@ void IntroWizardPage::showExternalInputSelector()
 
         QLineEdit *inputFileLineEdit = new QLineEdit(this);
         connect(inputFileLineEdit, &QLineEdit::textChanged, [=](){
+            startLoading(inputFileLineEdit->text());
             emit completeChanged();
         });
         selectedFiles[elem] = inputFileLineEdit;
@@ -140,6 +149,10 @@ void IntroWizardPage::showExternalInputSelector()
                                        "Choose file",
                                        QDir::homePath(),
                                        "All files (*.*)"));
+            fillFromTable(inputFileLineEdit->text());
+        });
+        connect(inputFileLineEdit, &QLineEdit::editingFinished, [=](){
+            fillFromTable(inputFileLineEdit->text());
         });
         inputSelectorLayout->addWidget(browseButton, i + 1, 2);
     }
@@ -164,19 +177,136 @@ void IntroWizardPage::hideExternalInputSelector()
     inputSelector = nullptr;
 }
 
+/* Private Function: startLoading(QString)
+ * ---------------------------------------
+ * Start reading the boundary condition in filename on
+ * a worker thread, unless it is being read already, or
+ * has been read and the file has not changed since.
+ *
+ * Called whenever the file of an external element
+ * changes.
+ */
+void IntroWizardPage::startLoading(QString filename)
+{
+    if (loading.contains(filename)) return;
+    if (loaded.contains(filename)) {
+        if (!loaded[filename]->fileChanged()) return;
+        delete loaded.take(filename);
+    }
+    if (!QFileInfo(filename).isFile()) return;
+    QFutureWatcher<BoundaryCondition *> *watcher = new QFutureWatcher<BoundaryCondition *>(this);
+    connect(watcher, &QFutureWatcher<BoundaryCondition *>::finished, this, [=](){
+        finishLoading(filename);
+    });
+    loading.insert(filename, watcher);
+    watcher->setFuture(QtConcurrent::run(&BoundaryCondition::load, filename));
+}
+
+/* Private Function: finishLoading(QString)
+ * ----------------------------------------
+ * Keep the boundary condition read from filename, show
+ * why it can not be used on the line edits holding it,
+ * and fill other elements from it if the user chose it.
+ *
+ * Called on the GUI thread when a worker has read the
+ * file.
+ */
+void IntroWizardPage::finishLoading(QString filename)
+{
+    QFutureWatcher<BoundaryCondition *> *watcher = loading.take(filename);
+    BoundaryCondition *bc = watcher->result();
+    watcher->deleteLater();
+    loaded.insert(filename, bc);
+    foreach(QLineEdit *line, selectedFiles) {
+        if (line->text() == filename)
+            line->setToolTip(bc->isValid() ? QString() : bc->errorString());
+    }
+    if (pendingFills.remove(filename)) fillFromTable(filename);
+    emit completeChanged();
+}
+
+/* Private Function: abandonLoading()
+ * -----------------------------------
+ * Stop waiting for the files still being read. A read
+ * already started can not be stopped, so its watcher is
+ * left to delete itself and the condition once done.
+ *
+ * Called when the page is left or deleted.
+ */
+void IntroWizardPage::abandonLoading()
+{
+    foreach(QFutureWatcher<BoundaryCondition *> *watcher, loading) {
+        disconnect(watcher, nullptr, this, nullptr);
+        watcher->setParent(nullptr);
+        // finished is delivered through the event loop, so it can not
+        // arrive between the check and the connection
+        if (watcher->isFinished()) {
+            delete watcher->result();
+            watcher->deleteLater();
+            continue;
+        }
+        connect(watcher, &QFutureWatcher<BoundaryCondition *>::finished, [watcher](){
+            delete watcher->result();
+            watcher->deleteLater();
+        });
+    }
+    loading.clear();
+    pendingFills.clear();
+}
+
+/* Private Function: fillFromTable(QString)
+ * ----------------------------------------
+ * If filename is a table with named value columns,
+ * give it to every external element with no file yet
+ * that has a column of its name, so one table can be
+ * chosen for all the outlets of a model. A file still
+ * being read is filled from once it has been.
+ *
+ * Called when the user chooses or types a file.
+ */
+void IntroWizardPage::fillFromTable(QString filename)
+{
+    if (filename.isEmpty()) return;
+    if (!loaded.contains(filename)) {
+        if (loading.contains(filename)) pendingFills.insert(filename);
+        return;
+    }
+    QStringList columns = loaded[filename]->columnNames();
+    if (columns.size() < 2) return;
+    foreach(QString elem, selectedFiles.keys()) {
+        if (selectedFiles[elem]->text().isEmpty() &&
+                BoundaryCondition::findColumn(columns, elem) >= 0)
+            selectedFiles[elem]->setText(filename);
+    }
+}
+
 /* Private Function: populateBoundaryConditions()
  * ----------------------------------------------
  * Populate the bcMap with BoundaryCondition objects
  * corresponding to the given filenames to be used in
- * the simulation.
+ * the simulation. Elements given the same file share
+ * one BoundaryCondition, which reads the file once and
+ * interpolates all of its columns together. The
+ * conditions were read when the files were chosen;
+ * those read for files no longer chosen are deleted,
+ * and files still being read are abandoned.
  *
  * Called when user agrees to go to the simulation page.
  */
 void IntroWizardPage::populateBoundaryConditions()
 {
+    QSet<QString> used;
     foreach(QString node, selectedFiles.keys()){
-        bcMap->insert(node, new BoundaryCondition(selectedFiles[node]->text()));
+        QString filename = selectedFiles[node]->text();
+        used.insert(filename);
+        bcMap->insert(node, loaded[filename]);
     }
+    foreach(QString filename, loaded.keys()) {
+        if (!used.contains(filename)) delete loaded.take(filename);
+    }
+    // the simulation owns the rest now
+    loaded.clear();
+    abandonLoading();
 }
 
 // =============== PROTECTED FUNCTIONS =========================================
@@ -184,7 +314,8 @@ void IntroWizardPage::populateBoundaryConditions()
 /* isComplete()
  * ------------
  * Activates next button only if the parse option
- * is selected or if the file to load is valid.
+ * is selected or if the file to load is valid, and
+ * every boundary condition file has been read.
  */
 bool IntroWizardPage::isComplete() const {
     if (parseButton->isChecked()) return true;
@@ -196,6 +327,7 @@ bool IntroWizardPage::isComplete() const {
         if (line->text().isEmpty()) return false;
         if (!(QFileInfo::exists(line->text()) &&
               QFileInfo(line->text()).isFile())) return false;
+        if (!loaded.contains(line->text())) return false;
     }
     return true;
 }
@@ -215,15 +347,44 @@ bool IntroWizardPage::validatePage() {
         return true;
     }
 
-    // Validate external input files given
+    // Read any file changed since it was chosen again, and wait for it
+    bool changed = false;
     foreach(QLineEdit *line, selectedFiles) {
-        if (line->text().isEmpty()) return false;
-        if (!BoundaryCondition::checkFile(line->text())){
+        if (loaded.contains(line->text()) && loaded[line->text()]->fileChanged()) {
+            startLoading(line->text());
+            changed = true;
+        }
+    }
+    if (changed) {
+        emit completeChanged();
+        return false;
+    }
+
+    // Validate external input files given, as read when they were chosen
+    foreach(QLineEdit *line, selectedFiles) {
+        if (line->text().isEmpty() || !loaded.contains(line->text())) return false;
+        BoundaryCondition *bc = loaded[line->text()];
+        if (!bc->isValid()) {
             QMessageBox::critical(this,
                                   "Bad Input File",
                                   "One or more input files provided "
                                   "is not correctly formatted. Format should"
-                                  " be: <time>\\t<value>");
+                                  " be: <time>\\t<value>\n\n" + bc->errorString());
+            // read it again, in case it is fixed before the next try
+            delete loaded.take(line->text());
+            startLoading(line->text());
+            emit completeChanged();
+            return false;
+        }
+    }
+    foreach(QString elem, selectedFiles.keys()) {
+        QString filename = selectedFiles[elem]->text();
+        QStringList columns = loaded[filename]->columnNames();
+        if (BoundaryCondition::findColumn(columns, elem) < 0) {
+            QMessageBox::critical(this,
+                                  "Bad Input File",
+                                  QFileInfo(filename).fileName() + " has several "
+                                  "value columns, but none named " + elem + ".");
             return false;
         }
     }
@@ -3,6 +3,7 @@
 
 #include "../simulation/boundarycondition.h"
 #include <QtWidgets>
+#include <QtConcurrent>
 
 /* CLASS: IntroWizardPage
  * ======================
@@ -16,6 +17,11 @@
  * Otherwise the user will be taken directly to the SimulateWizardPage. Before
  * being taken to SimulateWizardPage, the user will be asked if they want to
  * continue since they will not be able to return.
+ *
+ * Boundary condition files are read as soon as they are chosen, each on a
+ * QtConcurrent worker thread, so several files are read in parallel while
+ * the page stays responsive. The Next button is enabled once every file has
+ * been read, and the conditions read are the ones given to the simulation.
  */
 class IntroWizardPage : public QWizardPage
 {
@@ -23,6 +29,7 @@ class IntroWizardPage : public QWizardPage
 public:
     explicit IntroWizardPage(QMap<QString, BoundaryCondition *> *bcMap,
                              QWidget *parent = nullptr);
+    ~IntroWizardPage();
 
 signals:
     void parseCircuit();
@@ -46,7 +53,17 @@ private:
     QMap<QString, BoundaryCondition *> *bcMap;
     QWidget *inputSelector = nullptr;
     QMap<QString, QLineEdit *> selectedFiles;
+    void fillFromTable(QString filename);
     void populateBoundaryConditions();
+    // boundary condition files being read on worker threads, the conditions
+    // read from them (valid or not), and the files to fill other elements
+    // from once read (see fillFromTable())
+    QMap<QString, QFutureWatcher<BoundaryCondition *> *> loading;
+    QMap<QString, BoundaryCondition *> loaded;
+    QSet<QString> pendingFills;
+    void startLoading(QString filename);
+    void finishLoading(QString filename);
+    void abandonLoading();
 
 };
 
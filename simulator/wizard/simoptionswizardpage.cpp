@@ -72,6 +72,45 @@ QWidget *SimOptionsWizardPage::createTranExtension()
     registerField("tranStep", stepLineEdit);
     connect(stepLineEdit, &QLineEdit::textEdited, [this](){ emit completeChanged(); });
 
+    // Boundary condition points where the slope changes by at least this
+    // fraction of the steepest slope become ngspice breakpoints
+    QLabel *breakpointLabel = new QLabel("Breakpoint threshold: ", this);
+    QLineEdit *breakpointLineEdit = new QLineEdit(this);
+    breakpointLineEdit->setValidator(new QDoubleValidator(0, 1e6, 6, this));
+    breakpointLineEdit->setText(QString::number(BoundaryCondition::defaultBreakpointThreshold));
+    breakpointLineEdit->setToolTip("Relative change of boundary condition slope at which "
+                                   "ngspice is made to stop exactly (above 2: never)");
+    registerField("breakpointThreshold", breakpointLineEdit);
+
+    // Short runs may be done on the calling thread, without starting the
+    // ngspice background thread; the wizard does not respond meanwhile,
+    // so this is off by default
+    QLabel *foregroundLabel = new QLabel("Foreground cost: ", this);
+    QLineEdit *foregroundLineEdit = new QLineEdit(this);
+    foregroundLineEdit->setValidator(new QDoubleValidator(0, 1e12, 0, this));
+    foregroundLineEdit->setText(QString::number(SpiceEngine::defaultForegroundCost));
+    foregroundLineEdit->setToolTip("Circuits with fewer output points times vectors than this "
+                                   "are run without the ngspice background thread, blocking the "
+                                   "wizard until they end (0: never, the default)");
+    registerField("foregroundCost", foregroundLineEdit);
+
+    // Cubic interpolation of the boundary conditions has no corners
+    // at the points of the file for ngspice to stop on
+    QLabel *interpolationLabel = new QLabel("Interpolation: ", this);
+    QComboBox *interpolationComboBox = new QComboBox(this);
+    // in the order of BoundaryCondition::Interpolation
+    interpolationComboBox->addItems({"Linear", "Monotone cubic", "Periodic spline"});
+    interpolationComboBox->setToolTip("How boundary condition values are interpolated "
+                                      "between the points of their files");
+    registerField("bcInterpolation", interpolationComboBox, "currentIndex");
+
+    // With a fixed step, the boundary conditions can be read from values
+    // stored at every step instead of interpolated
+    QCheckBox *resampleCheckBox = new QCheckBox("Resample boundary conditions onto the step", this);
+    resampleCheckBox->setToolTip("Store boundary condition values at every time step of one "
+                                 "period before the run (for runs with a fixed step)");
+    registerField("bcResample", resampleCheckBox);
+
     QGridLayout *tranLayout = new QGridLayout;
     tranLayout->addWidget(stepLabel, 0, 0);
     tranLayout->addWidget(stepLineEdit, 0, 1);
@@ -81,6 +120,13 @@ QWidget *SimOptionsWizardPage::createTranExtension()
     tranLayout->addWidget(durationLineEdit, 1, 1);
     tranLayout->addWidget(durUnits, 1, 2);
     tranLayout->addWidget(unitsLabelTwo, 1, 3);
+    tranLayout->addWidget(breakpointLabel, 2, 0);
+    tranLayout->addWidget(breakpointLineEdit, 2, 1);
+    tranLayout->addWidget(foregroundLabel, 3, 0);
+    tranLayout->addWidget(foregroundLineEdit, 3, 1);
+    tranLayout->addWidget(interpolationLabel, 4, 0);
+    tranLayout->addWidget(interpolationComboBox, 4, 1);
+    tranLayout->addWidget(resampleCheckBox, 5, 0, 1, 4);
     tran->setLayout(tranLayout);
     return tran;
 }
@@ -3,6 +3,7 @@
 
 #include <QtWidgets>
 #include "../simulation/netlist.h"
+#include "../simulation/spiceengine.h"
 
 /* Class: SimOptionsWizardPage
  * ---------------------------
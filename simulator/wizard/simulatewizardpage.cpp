@@ -17,8 +17,13 @@ SimulateWizardPage::SimulateWizardPage(Netlist *netlist,
     dumpFilenameLineEdit = new QLineEdit(this);
     dumpFilenameLineEdit->setHidden(true);
     registerField("dumpFilename", dumpFilenameLineEdit);
+    // Vectors not listed here are never stored, which saves memory on long runs
+    QLineEdit *savedVectorsLineEdit = new QLineEdit(this);
+    savedVectorsLineEdit->setPlaceholderText("Vectors to keep, e.g. v(2) i(v1) (blank keeps all)");
+    registerField("savedVectors", savedVectorsLineEdit);
     QVBoxLayout *runLayout = new QVBoxLayout;
     runLayout->addWidget(runButton);
+    runLayout->addWidget(savedVectorsLineEdit);
     runLayout->addWidget(dumpOutputCheckbox);
     runLayout->addWidget(dumpFilenameLineEdit);
     runWidget->setLayout(runLayout);
@@ -28,11 +33,17 @@ SimulateWizardPage::SimulateWizardPage(Netlist *netlist,
     progressBar = new QProgressBar(this);
     pauseButton = new QPushButton("Pause", this);
     QPushButton *restartButton = new QPushButton("Restart", this);
-    QHBoxLayout *progressLayout = new QHBoxLayout;
-    progressLayout->addWidget(progressBar, 1);
+    QLineEdit *changesLineEdit = new QLineEdit(this);
+    changesLineEdit->setPlaceholderText("Change values and rerun, e.g. R1=20 C1=0.1");
+    QPushButton *applyButton = new QPushButton("Apply", this);
+    QGridLayout *progressLayout = new QGridLayout;
+    progressLayout->addWidget(progressBar, 0, 0);
+    progressLayout->setColumnStretch(0, 1);
     progressBar->setRange(0, 100);
-    progressLayout->addWidget(pauseButton);
-    progressLayout->addWidget(restartButton);
+    progressLayout->addWidget(pauseButton, 0, 1);
+    progressLayout->addWidget(restartButton, 0, 2);
+    progressLayout->addWidget(changesLineEdit, 1, 0, 1, 2);
+    progressLayout->addWidget(applyButton, 1, 2);
     progressWidget->setLayout(progressLayout);
     progressWidget->setHidden(true);
 
@@ -59,11 +70,16 @@ SimulateWizardPage::SimulateWizardPage(Netlist *netlist,
         }
     });
 
-    // restartButton -> stop and restart simulation
+    // restartButton -> stop and rerun the loaded circuit
     connect(restartButton, &QPushButton::pressed, [=](){
         stopSimulation();
         updateStatus(0);
-        startSimulation();
+        rerunSimulation();
+    });
+
+    // applyButton -> change element values in place and rerun
+    connect(applyButton, &QPushButton::pressed, [=](){
+        applyChanges(changesLineEdit->text());
     });
 
     // dumpOutputCheckbox -> show/hide dumpFilenameLineEdit
@@ -75,10 +91,27 @@ SimulateWizardPage::SimulateWizardPage(Netlist *netlist,
         }
     });
 
+    // progressTimer -> sample the progress of the simulation
+    // at a fixed rate, rather than on every ngspice status.
+    // Runs only while a simulation does, from when one is started
+    // until it is paused or done, or ngspice stops without saying so.
+    // The simulation time moves on even while the percentage does not,
+    // so the status is refreshed on every tick
+    progressTimer = new QTimer(this);
+    progressTimer->setInterval(100);
+    connect(progressTimer, &QTimer::timeout, [=](){
+        bool running = engine->running();
+        updateStatus(engine->progress());
+        if (!running && progressTimer->isActive()) {
+            progressTimer->stop();
+            if (plotButton) {
+                plotButton->setEnabled(true);
+                saveButton->setEnabled(true);
+            }
+        }
+    });
+
     // SIGNALS FROM ENGINE
-    connect(this->engine, &SpiceEngine::statusUpdate,
-            this, &SimulateWizardPage::updateStatus,
-            Qt::QueuedConnection);
 
     connect(this->engine, &SpiceEngine::spiceError,
             this, &SimulateWizardPage::receiveError,
@@ -122,6 +155,16 @@ void SimulateWizardPage::startSimulation()
         plotButton->setEnabled(false);
         saveButton->setEnabled(false);
     }
+    bool ok;
+    double threshold = field("breakpointThreshold").toDouble(&ok);
+    engine->setBreakpointThreshold(ok ? threshold : BoundaryCondition::defaultBreakpointThreshold);
+    double cost = field("foregroundCost").toDouble(&ok);
+    engine->setForegroundCost(ok ? cost : SpiceEngine::defaultForegroundCost);
+    engine->setInterpolation(static_cast<BoundaryCondition::Interpolation>(
+                                 field("bcInterpolation").toInt()));
+    engine->setResampling(field("bcResample").toBool());
+    engine->setSavedVectors(field("savedVectors").toString().split(QRegExp("\\s+"),
+                                                                  QString::SkipEmptyParts));
     int ret;
     if (field("loadCircuit").toBool()) {
         // TODO: allow user to provide filename for any External input elements
@@ -136,6 +179,7 @@ void SimulateWizardPage::startSimulation()
                                       field("dumpFilename").toString());
     }
     if (ret != 0) showErrorMessage();
+    else progressTimer->start();
 
     emit completeChanged();
 }
@@ -147,25 +191,80 @@ void SimulateWizardPage::startSimulation()
  */
 void SimulateWizardPage::continueSimulation()
 {
-    plotButton->setEnabled(false);
-    saveButton->setEnabled(false);
+    if (plotButton) {
+        plotButton->setEnabled(false);
+        saveButton->setEnabled(false);
+    }
     int ret = engine->resumeSimulation();
     if (ret != 0) showErrorMessage();
+    else progressTimer->start();
+
+    emit completeChanged();
+}
+
+/* Private Function: rerunSimulation()
+ * ------------------------------------
+ * Run the circuit already loaded in ngspice
+ * again from the start, without parsing it
+ * again. Disable plot and save buttons.
+ */
+void SimulateWizardPage::rerunSimulation()
+{
+    if (plotButton && plotButton->isEnabled()) {
+        plotButton->setEnabled(false);
+        saveButton->setEnabled(false);
+    }
+    int ret = engine->rerunSimulation();
+    if (ret != 0) showErrorMessage();
+    else progressTimer->start();
 
     emit completeChanged();
 }
 
+/* Private Function: applyChanges(QString)
+ * ---------------------------------------
+ * Parse changes of the form <element>=<value>,
+ * separated by spaces, apply them to the loaded
+ * circuit and rerun it.
+ */
+void SimulateWizardPage::applyChanges(QString changes)
+{
+    QMap<QString, QString> values;
+    foreach(QString change, changes.split(QRegExp("\\s+"), QString::SkipEmptyParts)) {
+        int eq = change.indexOf('=');
+        if (eq <= 0 || eq == change.length() - 1) {
+            QMessageBox::warning(this, "Invalid change",
+                                 "Changes must be of the form <element>=<value>: " + change);
+            return;
+        }
+        values[change.left(eq)] = change.mid(eq + 1);
+    }
+    if (values.isEmpty()) return;
+
+    stopSimulation();
+    int ret = engine->alterParameters(values);
+    if (ret != 0) {
+        showErrorMessage();
+        return;
+    }
+    updateStatus(0);
+    rerunSimulation();
+}
+
 /* Private Function: stopSimulation()
  * ----------------------------------
- * Pause simulation. Enable finish, plot and
- * save buttons.
+ * Pause simulation and stop sampling its progress.
+ * Enable finish, plot and save buttons.
  */
 void SimulateWizardPage::stopSimulation()
 {
+    progressTimer->stop();
     int ret = engine->stopSimulation();
     if (ret != 0) showErrorMessage();
-    plotButton->setEnabled(true);
-    saveButton->setEnabled(true);
+    if (plotButton) {
+        plotButton->setEnabled(true);
+        saveButton->setEnabled(true);
+    }
 
     emit completeChanged();
 }
@@ -376,7 +475,9 @@ void SimulateWizardPage::initData()
     disconnect(engine, &SpiceEngine::initDataReady,
             this, &SimulateWizardPage::initData);
 
-    resultsLabel->setText(engine->getPlotInfo() + "\n\nVectors:");
+    QString saveInfo = engine->getSaveInfo();
+    if (!saveInfo.isEmpty()) saveInfo = "\n" + saveInfo;
+    resultsLabel->setText(engine->getPlotInfo() + saveInfo + "\n\nVectors:");
     vectors = engine->vectors();
     for (int i = 0; i < vectors.length(); i++) {
         if (vectors[i] == "time") continue;
@@ -435,20 +536,36 @@ bool SimulateWizardPage::isComplete() const
 
 /* Slot: updateStatus(int)
  * -----------------------
- * Gets progress from engine and updates
- * progress bar.
- * Handles complete simulations
+ * Updates the progress bar with progress sampled
+ * from the engine, and the simulation time.
+ * Handles complete simulations, showing the number
+ * of time steps taken, and any output lines dropped
+ * from the dump file, on the progress bar, and
+ * stopping the progress timer. The plot and save
+ * buttons do not exist until ngspice has sent its
+ * init data.
  */
 void SimulateWizardPage::updateStatus(int progress)
 {
     progressBar->setValue(progress);
     if (progress == 100) {
-        plotButton->setEnabled(true);
-        saveButton->setEnabled(true);
+        progressTimer->stop();
+        QString format = QString("%p% (%1 time steps, %2 rejected")
+                .arg(engine->steps()).arg(engine->rejectedSteps());
+        if (engine->droppedOutputLines() > 0)
+            format += QString(", %1 output lines not written").arg(engine->droppedOutputLines());
+        progressBar->setFormat(format + ")");
+        if (plotButton) {
+            plotButton->setEnabled(true);
+            saveButton->setEnabled(true);
+        }
         pauseButton->setEnabled(false);
     } else {
-        plotButton->setEnabled(false);
-        saveButton->setEnabled(false);
+        progressBar->setFormat(QString("%p% (t = %1)").arg(engine->simulationTime()));
+        if (plotButton) {
+            plotButton->setEnabled(false);
+            saveButton->setEnabled(false);
+        }
         pauseButton->setEnabled(true);
     }
     emit completeChanged();
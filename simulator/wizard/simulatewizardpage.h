@@ -43,6 +43,7 @@ private:
     QPushButton *saveButton = nullptr;
     QPushButton *plotButton = nullptr;
     QPushButton *pauseButton = nullptr;
+    QTimer *progressTimer = nullptr;
     bool running;
     bool resultsInitialized = false;
     QList<QString> vectors;
@@ -54,6 +55,8 @@ private:
     void startSimulation();
     void continueSimulation();
     void stopSimulation();
+    void rerunSimulation();
+    void applyChanges(QString changes);
     void showResults();
     void initData();
     void writeVectors();